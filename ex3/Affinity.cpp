@@ -0,0 +1,115 @@
+#include "Affinity.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// the NUMA node of each CPU in cpus, 0 when the system lists no nodes
+static std::vector<int> cpuNodes(const std::vector<int> &cpus) {
+  std::vector<int> nodes(cpus.size(), 0);
+  for (int node = 0;; node++) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+    if (!in) {
+      break;
+    }
+    // a list of ranges, e.g. 0-3,8-11
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      int first, last;
+      int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+      if (fields < 1) {
+        continue;
+      }
+      if (fields == 1) {
+        last = first;
+      }
+      for (size_t i = 0; i < cpus.size(); i++) {
+        if (cpus[i] >= first && cpus[i] <= last) {
+          nodes[i] = node;
+        }
+      }
+    }
+  }
+  return nodes;
+}
+
+std::vector<int> planAffinity(affinity_t policy, const int *cpus, int numCpus,
+                              int numThreads) {
+  std::vector<int> plan;
+  if (policy != COMPACT_AFFINITY && policy != SCATTER_AFFINITY &&
+      policy != LIST_AFFINITY) {
+    return plan;
+  }
+
+  cpu_set_t allowed;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) != 0) {
+    return plan;
+  }
+  if (policy == LIST_AFFINITY) {
+    // listed CPUs the thread may not run on are dropped, pinning to them
+    // would fail
+    std::vector<int> listed;
+    for (int i = 0; i < numCpus; i++) {
+      if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE &&
+          CPU_ISSET(cpus[i], &allowed)) {
+        listed.push_back(cpus[i]);
+      }
+    }
+    for (int i = 0; i < numThreads && !listed.empty(); i++) {
+      plan.push_back(listed[i % listed.size()]);
+    }
+    return plan;
+  }
+  std::vector<int> available;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      available.push_back(cpu);
+    }
+  }
+  std::vector<int> nodes = cpuNodes(available);
+  // the available CPUs of each node, in node order
+  std::vector<std::vector<int>> byNode;
+  std::vector<int> nodeIds = nodes;
+  std::sort(nodeIds.begin(), nodeIds.end());
+  nodeIds.erase(std::unique(nodeIds.begin(), nodeIds.end()), nodeIds.end());
+  for (int node : nodeIds) {
+    byNode.emplace_back();
+    for (size_t i = 0; i < available.size(); i++) {
+      if (nodes[i] == node) {
+        byNode.back().push_back(available[i]);
+      }
+    }
+  }
+
+  for (int i = 0; i < numThreads; i++) {
+    if (policy == COMPACT_AFFINITY) {
+      // node after node, wrapping around when there are more threads
+      int index = i % available.size();
+      for (const std::vector<int> &node : byNode) {
+        if (index < (int)node.size()) {
+          plan.push_back(node[index]);
+          break;
+        }
+        index -= node.size();
+      }
+    } else {
+      const std::vector<int> &node = byNode[i % byNode.size()];
+      plan.push_back(node[(i / byNode.size()) % node.size()]);
+    }
+  }
+  return plan;
+}
+
+int pinThread(int cpu, cpu_set_t *previous) {
+  int error = pthread_getaffinity_np(pthread_self(), sizeof(*previous),
+                                     previous);
+  if (error != 0) {
+    return error;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
@@ -0,0 +1,19 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+#include "MapReduceFramework.h"
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+// the CPU each of numThreads threads runs on under an affinity policy,
+// empty for no pinning. compact and scatter use the CPUs the calling thread
+// may run on, grouped by NUMA node as listed in sysfs. list drops the CPUs
+// the calling thread may not run on
+std::vector<int> planAffinity(affinity_t policy, const int *cpus, int numCpus,
+                              int numThreads);
+
+// pin the calling thread to a CPU, saving its previous CPU set. returns an
+// error number like pthread_setaffinity_np
+int pinThread(int cpu, cpu_set_t *previous);
+
+#endif // AFFINITY_H
@@ -0,0 +1,45 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// size of the blocks the arena allocates from
+#define BLOCK_SIZE (64 * 1024)
+// alignment of allocations, same as malloc
+#define ALIGNMENT alignof(std::max_align_t)
+
+Arena::Arena() : next(nullptr), end(nullptr) {}
+
+Arena::~Arena() { clear(); }
+
+void *Arena::allocate(size_t size) {
+  // round up so the next allocation stays aligned
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  if (size > (size_t)(end - next)) {
+    grow(size);
+  }
+  void *p = next;
+  next += size;
+  return p;
+}
+
+void Arena::clear() {
+  for (char *block : blocks) {
+    free(block);
+  }
+  blocks.clear();
+  next = end = nullptr;
+}
+
+void Arena::grow(size_t size) {
+  // oversized allocations get a block of their own
+  size_t blockSize = std::max<size_t>(size, BLOCK_SIZE);
+  char *block = static_cast<char *>(malloc(blockSize));
+  if (block == nullptr) {
+    std::cerr << "[[MapReduceFramework]] error on malloc" << std::endl;
+    exit(1);
+  }
+  blocks.push_back(block);
+  next = block;
+  end = block + blockSize;
+}
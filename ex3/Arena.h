@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <vector>
+
+// a bump allocator. memory is handed out from large blocks and freed all at
+// once, there is no per-allocation free. not thread safe, each thread of a
+// job has its own arena
+class Arena {
+private:
+  std::vector<char *> blocks;
+  // free space in the current block
+  char *next;
+  char *end;
+
+  // start a new block with room for at least size bytes
+  void grow(size_t size);
+
+public:
+  Arena();
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // allocate size bytes aligned for any fundamental type
+  void *allocate(size_t size);
+  // free all memory allocated from the arena
+  void clear();
+};
+
+#endif // ARENA_H
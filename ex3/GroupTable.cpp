@@ -0,0 +1,56 @@
+#include "GroupTable.h"
+#include <cstdint>
+
+// mix the bits of a client hash, so keys that differ only in their high bits
+// don't collide in the low bits used for the slot index
+static size_t mix(size_t hash) {
+  uint64_t h = hash;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  // 0 marks a hash that is not stored yet
+  return (size_t)h | 1;
+}
+
+GroupTable::GroupTable(size_t numKeys) : claimed(0) {
+  size_t size = 4;
+  while (size < 2 * numKeys) {
+    size *= 2;
+  }
+  // value initialized, all slots empty
+  slots = std::vector<Slot>(size);
+  mask = size - 1;
+  // probes stay short, and there's always an empty slot to end them
+  maxKeys = size / 4 * 3;
+}
+
+size_t GroupTable::insert(K2 *key) {
+  size_t hash = mix(key->hash());
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    Slot &s = slots[slot];
+    K2 *other = s.key.load(std::memory_order_acquire);
+    if (other == nullptr) {
+      // reserve room for the key before claiming the slot
+      if (claimed.fetch_add(1) >= maxKeys) {
+        claimed.fetch_sub(1);
+        return FULL;
+      }
+      if (s.key.compare_exchange_strong(other, key,
+                                        std::memory_order_acq_rel)) {
+        s.hash.store(hash, std::memory_order_release);
+        s.count.fetch_add(1);
+        return slot;
+      }
+      // lost the slot to another key, which may still be this key
+      claimed.fetch_sub(1);
+    }
+    // a stored hash rules out most other keys without calling equals
+    size_t otherHash = s.hash.load(std::memory_order_acquire);
+    if ((otherHash == 0 || otherHash == hash) && key->equals(*other)) {
+      s.count.fetch_add(1);
+      return slot;
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef GROUPTABLE_H
+#define GROUPTABLE_H
+#include "MapReduceClient.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a concurrent open-addressing hash table from intermediate keys to slots,
+// for grouping pairs by K2::hash and K2::equals instead of sorting them.
+// slots are claimed with a compare-and-swap on the key and probed linearly,
+// so threads insert without locks. keys are never removed. a table sized
+// for too few keys reports that it's full rather than growing, so the keys
+// can be inserted again into a larger one
+class GroupTable {
+public:
+  // returned by insert when there's no room for a new key
+  static const size_t FULL = SIZE_MAX;
+
+  // a table for numKeys distinct keys, half full with that many and taking
+  // keys up to three quarters full
+  explicit GroupTable(size_t numKeys);
+  GroupTable(const GroupTable &) = delete;
+  GroupTable &operator=(const GroupTable &) = delete;
+
+  // find the slot of key, claiming an empty slot if the key is new, and
+  // count a pair in it. returns FULL when the key is new and the table has
+  // no room for it. lock-free
+  size_t insert(K2 *key);
+  size_t capacity() const { return slots.size(); }
+  // number of pairs counted in a slot, 0 when it's empty
+  int count(size_t slot) const { return slots[slot].count.load(); }
+  // group of a slot, set by whoever numbers the groups
+  int getGroup(size_t slot) const { return slots[slot].group; }
+  void setGroup(size_t slot, int group) { slots[slot].group = group; }
+  // take the position of a pair in the group of a slot, counting down from
+  // count(slot) - 1. thread safe
+  int take(size_t slot) { return slots[slot].count.fetch_sub(1) - 1; }
+
+private:
+  struct Slot {
+    // null when the slot is empty
+    std::atomic<K2 *> key;
+    // mixed hash of the key, 0 until the claiming thread stores it
+    std::atomic<size_t> hash;
+    std::atomic<int> count;
+    int group;
+  };
+  std::vector<Slot> slots;
+  size_t mask;
+  // number of claimed slots, and the most there may be
+  std::atomic<size_t> claimed;
+  size_t maxKeys;
+};
+
+#endif // GROUPTABLE_H
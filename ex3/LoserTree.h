@@ -0,0 +1,128 @@
+#ifndef LOSERTREE_H
+#define LOSERTREE_H
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// a tournament tree merging k sorted runs.
+// each internal node keeps the loser of the match played there and the
+// overall winner sits in tree[0], so popping an element replays a single
+// leaf-to-root path: log(k) comparisons per element instead of k.
+// ties are won by the run with the lower index, so the merge is stable.
+
+template <class Iterator, class Before> class LoserTree {
+public:
+  typedef typename std::iterator_traits<Iterator>::value_type value_type;
+  typedef std::pair<Iterator, Iterator> Run;
+
+  // runs are [first, second) ranges, each sorted by before
+  LoserTree(const std::vector<Run> &runs, Before before)
+      : runs(runs), k(runs.size()), heads(runs.size()), tree(runs.size(), -1),
+        before(before) {
+    for (int i = 0; i < k; i++) {
+      updateHead(i);
+    }
+    // play every leaf up until it parks at a node nobody reached yet
+    for (int i = 0; i < k; i++) {
+      int winner = i;
+      for (int node = (i + k) / 2; node > 0 && winner != -1; node /= 2) {
+        if (tree[node] == -1) {
+          tree[node] = winner;
+          winner = -1;
+        } else if (beats(tree[node], winner)) {
+          std::swap(tree[node], winner);
+        }
+      }
+      if (winner != -1) {
+        tree[0] = winner;
+      }
+    }
+  }
+
+  bool empty() const { return k == 0 || heads[tree[0]] == nullptr; }
+
+  // the next element of the merge. tree must not be empty
+  const value_type &top() const { return *heads[tree[0]]; }
+
+  // index of the run holding the next element
+  int topRun() const { return tree[0]; }
+
+  // remove and return the next element of the merge
+  value_type pop() {
+    int winner = tree[0];
+    value_type value = std::move(*heads[winner]);
+    ++runs[winner].first;
+    updateHead(winner);
+    replay(winner);
+    return value;
+  }
+
+  // move the next element and all elements equal to it to out.
+  // equal elements left in the winning run are taken before replaying, so
+  // each costs one comparison however many runs there are
+  template <class Container> void popEqual(Container &out) {
+    const value_type key = *heads[tree[0]];
+    do {
+      int winner = tree[0];
+      do {
+        out.push_back(std::move(*heads[winner]));
+        ++runs[winner].first;
+        updateHead(winner);
+      } while (heads[winner] != nullptr && !before(key, *heads[winner]));
+      replay(winner);
+    } while (!empty() && !before(key, top()));
+  }
+
+  // skip the elements popEqual would move, leaving them in place, and call
+  // visit(first, last) with the range [first, last) skipped in each run
+  template <class Visitor> void skipEqual(Visitor visit) {
+    const value_type key = *heads[tree[0]];
+    do {
+      int winner = tree[0];
+      Iterator first = runs[winner].first;
+      do {
+        ++runs[winner].first;
+        updateHead(winner);
+      } while (heads[winner] != nullptr && !before(key, *heads[winner]));
+      visit(first, runs[winner].first);
+      replay(winner);
+    } while (!empty() && !before(key, top()));
+  }
+
+private:
+  std::vector<Run> runs;
+  int k;
+  // current element of each run, null once the run is exhausted
+  std::vector<value_type *> heads;
+  // tree[0] is the winner, tree[1..k-1] are the losers of internal nodes
+  std::vector<int> tree;
+  Before before;
+
+  // replay the matches on the path of an advanced run
+  void replay(int winner) {
+    for (int node = (winner + k) / 2; node > 0; node /= 2) {
+      if (beats(tree[node], winner)) {
+        std::swap(tree[node], winner);
+      }
+    }
+    tree[0] = winner;
+  }
+
+  void updateHead(int run) {
+    heads[run] =
+        (runs[run].first == runs[run].second) ? nullptr : &*runs[run].first;
+  }
+
+  // whether run a wins over run b. exhausted runs always lose
+  bool beats(int a, int b) const {
+    const value_type *headA = heads[a], *headB = heads[b];
+    if (headA == nullptr || headB == nullptr) {
+      return headB == nullptr && (headA != nullptr || a < b);
+    }
+    // a single comparison, breaking ties by run index
+    return a < b ? !before(*headB, *headA) : before(*headA, *headB);
+  }
+};
+
+#endif // LOSERTREE_H
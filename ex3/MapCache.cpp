@@ -0,0 +1,31 @@
+#include "MapCache.h"
+
+const MapCache::Entry *MapCache::find(uint64_t fingerprint) const {
+  auto entry = entries.find(fingerprint);
+  return (entry == entries.end()) ? nullptr : &entry->second;
+}
+
+void MapCache::touch(uint64_t fingerprint) {
+  auto entry = entries.find(fingerprint);
+  if (entry != entries.end()) {
+    entry->second.run = run;
+  }
+}
+
+void MapCache::add(uint64_t fingerprint, Entry &entry) {
+  Entry &cached = entries[fingerprint];
+  cached.pairs.swap(entry.pairs);
+  cached.numPairs = entry.numPairs;
+  cached.run = run;
+}
+
+void MapCache::finishRun() {
+  for (auto entry = entries.begin(); entry != entries.end();) {
+    if (entry->second.run != run) {
+      entry = entries.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+  run++;
+}
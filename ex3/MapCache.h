@@ -0,0 +1,48 @@
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// the map output of each input of a job, kept for the next run of the job.
+// inputs are known by the client's fingerprint, and their intermediate pairs
+// are kept serialized, like spilled pairs. a run replays the pairs of the
+// inputs it finds and maps the rest, and entries of inputs a run didn't
+// have are dropped after it.
+// the cache isn't thread safe: lookups may run in parallel, but entries are
+// touched and added by one thread once the map phase is done.
+class MapCache {
+public:
+  // the serialized intermediate pairs of an input
+  struct Entry {
+    std::string pairs;
+    size_t numPairs;
+    // the last run that had the input
+    unsigned run;
+  };
+
+private:
+  std::unordered_map<uint64_t, Entry> entries;
+  // number of the current run
+  unsigned run;
+
+public:
+  MapCache() : run(0) {}
+  MapCache(const MapCache &) = delete;
+  MapCache &operator=(const MapCache &) = delete;
+
+  // the entry of an input, null if it isn't cached
+  const Entry *find(uint64_t fingerprint) const;
+  // the current run had a cached input
+  void touch(uint64_t fingerprint);
+  // cache the pairs of an input mapped in the current run, taking the
+  // serialized pairs of the entry
+  void add(uint64_t fingerprint, Entry &entry);
+  // drop the entries the current run didn't have, and start the next run
+  void finishRun();
+
+  size_t size() const { return entries.size(); }
+};
+
+#endif // MAPCACHE_H
@@ -0,0 +1,103 @@
+#ifndef MAPREDUCEASYNC_H
+#define MAPREDUCEASYNC_H
+
+#include "MapReduceFramework.h"
+
+// C++20 coroutines for clients that map asynchronously (see
+// MapReduceClient::mapsAsync). a client derives from async::Client and
+// writes its map as a coroutine that co_awaits async::suspend to wait:
+//
+//   struct Client : public async::Client {
+//     async::MapTask mapCoroutine(const K1 *key, const V1 *value,
+//                                 void *context) const {
+//       Reply reply;
+//       co_await async::suspend(context, [&](async::Wake wake) {
+//         // start the request, call wake() once reply is filled
+//       });
+//       emit2(..., context);
+//     }
+//   };
+//
+// the library is built as C++11, this header is for clients built as C++20.
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <exception>
+
+namespace async {
+
+// the coroutine of a map. it runs until its first suspension when called
+struct MapTask {
+  struct promise_type {
+    MapTask get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    // kept alive when done, so the client sees it's done and destroys it
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+  std::coroutine_handle<promise_type> handle;
+};
+
+// resumes a suspended map when called, from any thread
+struct Wake {
+  void *item;
+  void *context;
+  void operator()() const { wakeMap(item, context); }
+};
+
+// an awaitable suspending a map, start gets the Wake of the map once it's
+// suspended
+template <class Start> struct Suspend {
+  void *context;
+  Start start;
+  bool await_ready() const { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    start(Wake{handle.address(), context});
+  }
+  void await_resume() const {}
+};
+
+template <class Start> Suspend<Start> suspend(void *context, Start start) {
+  return {context, start};
+}
+
+class Client : public MapReduceClient {
+public:
+  virtual MapTask mapCoroutine(const K1 *key, const V1 *value,
+                               void *context) const = 0;
+
+  bool mapsAsync() const override { return true; }
+  // never called, maps go through mapAsync
+  void map(const K1 *key, const V1 *value, void *context) const override {}
+
+  void *mapAsync(const K1 *key, const V1 *value,
+                 void *context) const override {
+    return suspended(mapCoroutine(key, value, context).handle);
+  }
+  void *resumeMap(void *item, void *context) const override {
+    auto handle =
+        std::coroutine_handle<MapTask::promise_type>::from_address(item);
+    handle.resume();
+    return suspended(handle);
+  }
+
+private:
+  // the item of a suspended map, null once the map is done
+  static void *suspended(std::coroutine_handle<MapTask::promise_type> handle) {
+    if (handle.done()) {
+      handle.destroy();
+      return nullptr;
+    }
+    return handle.address();
+  }
+};
+
+} // namespace async
+
+#endif // __cplusplus >= 202002L
+
+#endif // MAPREDUCEASYNC_H
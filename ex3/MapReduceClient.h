@@ -3,6 +3,10 @@
 
 #include <vector>  //std::vector
 #include <utility> //std::pair
+#include <iosfwd>  //std::istream, std::ostream
+#include <cstddef> //size_t
+#include <cstdint> //uint64_t
+#include <iterator> //std::forward_iterator_tag
 
 // input key and value.
 // the key, value for the map function and the MapReduceFramework
@@ -23,11 +27,24 @@ class K2 {
 public:
 	virtual ~K2(){}
 	virtual bool operator<(const K2 &other) const = 0;
+	// optional, for clients that spill (see MapReduceClient::spills)
+	virtual void serialize(std::ostream &out) const {}
+	// optional, for clients that group by hash (see MapReduceClient::hashes).
+	// equal keys must have equal hashes
+	virtual size_t hash() const { return 0; }
+	virtual bool equals(const K2 &other) const {
+		return !(*this < other) && !(other < *this);
+	}
+	// optional, for clients that radix sort (see
+	// MapReduceClient::normalizesKeys)
+	virtual uint64_t normalizedKey() const { return 0; }
 };
 
 class V2 {
 public:
 	virtual ~V2(){}
+	// optional, for clients that spill (see MapReduceClient::spills)
+	virtual void serialize(std::ostream &out) const {}
 };
 
 // output key and value
@@ -51,6 +68,73 @@ typedef std::vector<InputPair> InputVec;
 typedef std::vector<IntermediatePair> IntermediateVec;
 typedef std::vector<OutputPair> OutputVec;
 
+// a contiguous range [begin, end) of pairs in a sorted run
+struct PairSpan {
+	const IntermediatePair *begin;
+	const IntermediatePair *end;
+};
+
+// the pairs of a single K2 key, as spans of the sorted runs holding them,
+// so a group can be reduced without copying its pairs into a vector.
+// the pairs of a span are in run order, the spans in no particular order
+class GroupView {
+public:
+	// a forward iterator over the pairs of all spans
+	class iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef IntermediatePair value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const IntermediatePair *pointer;
+		typedef const IntermediatePair &reference;
+
+		iterator(const PairSpan *span, const PairSpan *last)
+			: span(span), last(last),
+			  pair(span == last ? nullptr : span->begin) {}
+		reference operator*() const { return *pair; }
+		pointer operator->() const { return pair; }
+		iterator &operator++() {
+			if (++pair == span->end) {
+				pair = (++span == last) ? nullptr : span->begin;
+			}
+			return *this;
+		}
+		iterator operator++(int) {
+			iterator old = *this;
+			++*this;
+			return old;
+		}
+		bool operator==(const iterator &other) const {
+			return pair == other.pair;
+		}
+		bool operator!=(const iterator &other) const {
+			return pair != other.pair;
+		}
+
+	private:
+		const PairSpan *span;
+		const PairSpan *last;
+		const IntermediatePair *pair;
+	};
+
+	GroupView() : first(nullptr), last(nullptr), count(0) {}
+	// spans [first, last), none of them empty, holding count pairs
+	GroupView(const PairSpan *first, const PairSpan *last, size_t count)
+		: first(first), last(last), count(count) {}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	iterator begin() const { return iterator(first, last); }
+	iterator end() const { return iterator(last, last); }
+	const PairSpan *spanBegin() const { return first; }
+	const PairSpan *spanEnd() const { return last; }
+
+private:
+	const PairSpan *first;
+	const PairSpan *last;
+	size_t count;
+};
+
 
 class MapReduceClient {
 public:
@@ -62,6 +146,85 @@ public:
 	// calls emit3(K3, V3, context) any number of times (usually once)
 	// to output (K3, V3) pairs.
 	virtual void reduce(const IntermediateVec* pairs, void* context) const = 0;
+
+	// optional zero-copy reduce, called by the framework instead of reduce.
+	// gets the pairs of a single K2 key as a view into the sorted runs, which
+	// reducers that only iterate the pairs can use without a copy. like in
+	// reduce, the pairs are handed over to the client. the default copies
+	// the pairs to a vector and calls reduce.
+	virtual void reduceGroup(const GroupView* group, void* context) const {
+		IntermediateVec pairs(group->begin(), group->end());
+		reduce(&pairs, context);
+	}
+
+	// optional combiner, used when combines() returns true.
+	// gets pairs with a single K2 key from one thread's sorted pairs, before
+	// the shuffle, and calls emit2(K2, V2, context) to fold them into fewer
+	// pairs. emitted pairs must have the same key. like in reduce, the given
+	// pairs are handed over to the client.
+	virtual bool combines() const { return false; }
+	virtual void combine(const IntermediateVec* pairs, void* context) const {}
+
+	// optional spilling, used when spills() returns true and the job has a
+	// memory budget. intermediate pairs over the budget are written to disk
+	// with K2::serialize and V2::serialize and deleted, then read back by
+	// deserialize as new pairs. spilled pairs must be allocated with new.
+	virtual bool spills() const { return false; }
+	virtual IntermediatePair deserialize(std::istream &in) const {
+		return IntermediatePair(nullptr, nullptr);
+	}
+
+	// optional skew handling, used when associative() returns true.
+	// declares that combine can fold any part of a group, and that reducing
+	// the folded pairs gives the same output as reducing the whole group.
+	// groups much larger than the rest are then split into parts that are
+	// combined in parallel before the group is reduced. clients that return
+	// true must implement combine, whether or not combines() returns true.
+	virtual bool associative() const { return false; }
+
+	// optional radix sort, used when normalizesKeys() returns true.
+	// K2::normalizedKey maps keys to integers in their order: a < b implies
+	// a.normalizedKey() <= b.normalizedKey(), e.g. an integer key itself or
+	// the first 8 bytes of a string key, big-endian. runs are radix sorted
+	// by normalized key, and only keys with equal normalized keys are
+	// compared with operator<.
+	virtual bool normalizesKeys() const { return false; }
+
+	// optional hash grouping, used when hashes() returns true.
+	// pairs are grouped by K2::hash and K2::equals in a hash table instead of
+	// being sorted, so groups come to reduce in no particular order. jobs
+	// that group by hash don't combine or spill.
+	virtual bool hashes() const { return false; }
+
+	// optional asynchronous map, used when mapsAsync() returns true, for
+	// maps that wait (e.g. for I/O) without holding their thread. mapAsync
+	// maps a pair like map, but may suspend instead of waiting by returning
+	// an item, any non-null pointer holding the state of the map. once the
+	// map can go on the client calls wakeMap(item, context) from any thread,
+	// and resumeMap(item, context) is then called on the thread that started
+	// it, returning null when the map is done or the item to suspend again.
+	// a thread keeps a number of maps suspended at a time (see
+	// JobConfig::mapsInFlight), and the pairs of a map stay alive until it's
+	// done. jobs of clients that map asynchronously don't use a map cache.
+	virtual bool mapsAsync() const { return false; }
+	virtual void* mapAsync(const K1* key, const V1* value,
+		void* context) const {
+		map(key, value, context);
+		return nullptr;
+	}
+	virtual void* resumeMap(void* item, void* context) const {
+		return nullptr;
+	}
+
+	// optional incremental map, used when the job has a map cache.
+	// fingerprint gives inputs that map to the same pairs the same value,
+	// e.g. a hash of the key and the version of its value. the pairs of
+	// inputs are cached with K2::serialize and V2::serialize and replayed
+	// with deserialize as new pairs, so the client must implement them like
+	// a client that spills, and emitted pairs must be allocated with new.
+	virtual uint64_t fingerprint(const K1* key, const V1* value) const {
+		return 0;
+	}
 };
 
 
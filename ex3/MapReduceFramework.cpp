@@ -1,12 +1,123 @@
 #include "MapReduceFramework.h"
 #include "MapReduceJob.h"
+#include <algorithm>
 #include <iostream>
 
+// number of pairs a pipe between pipeline stages holds per reading thread
+#define PIPE_CAPACITY_PER_THREAD 1024
+
+// the weight of a job on its pool, 0 stands for 1
+static double weight(const JobConfig &config) {
+  return (config.weight > 0) ? config.weight : 1;
+}
+
 JobHandle startMapReduceJob(const MapReduceClient &client,
                             const InputVec &inputVec, OutputVec &outputVec,
                             int multiThreadLevel) {
+  return startMapReduceJob(&WorkerPool::defaultPool(), client, inputVec,
+                           outputVec, multiThreadLevel);
+}
+
+PoolHandle createWorkerPool(int numThreads, int maxThreads) {
+  WorkerPool *pool = new WorkerPool(numThreads, maxThreads);
+  return static_cast<PoolHandle>(pool);
+}
+
+void closeWorkerPool(PoolHandle handle) {
+  WorkerPool *pool = static_cast<WorkerPool *>(handle);
+  delete pool;
+}
+
+MapCacheHandle createMapCache() {
+  MapCache *cache = new MapCache();
+  return static_cast<MapCacheHandle>(cache);
+}
+
+void closeMapCache(MapCacheHandle handle) {
+  MapCache *cache = static_cast<MapCache *>(handle);
+  delete cache;
+}
+
+JobHandle startMapReduceJob(PoolHandle handle, const MapReduceClient &client,
+                            const InputVec &inputVec, OutputVec &outputVec,
+                            int multiThreadLevel, const JobConfig &config) {
+  WorkerPool *pool = static_cast<WorkerPool *>(handle);
+  MapReduceJob *job =
+      new MapReduceJob(*pool, client, inputVec, nullptr, outputVec,
+                       pool->reserveThreads(multiThreadLevel, weight(config)),
+                       config);
+  return static_cast<JobHandle>(job);
+}
+
+JobHandle startMapReduceJob(PoolHandle handle, const MapReduceClient &client,
+                            InputSource &source, OutputVec &outputVec,
+                            int multiThreadLevel, const JobConfig &config) {
+  // the job reads no input vector
+  static const InputVec noInput;
+  WorkerPool *pool = static_cast<WorkerPool *>(handle);
   MapReduceJob *job =
-      new MapReduceJob(client, inputVec, outputVec, multiThreadLevel);
+      new MapReduceJob(*pool, client, noInput, &source, outputVec,
+                       pool->reserveThreads(multiThreadLevel, weight(config)),
+                       config);
+  return static_cast<JobHandle>(job);
+}
+
+JobHandle startPipeline(PoolHandle handle, const PipelineStage *stages,
+                        int numStages, const InputVec &inputVec,
+                        OutputVec &outputVec) {
+  WorkerPool *pool = static_cast<WorkerPool *>(handle);
+  // the stages share the bound of the pool, in proportion to their threads
+  std::vector<int> threads(numStages);
+  int total = 0;
+  for (int i = 0; i < numStages; i++) {
+    threads[i] = std::max(1, stages[i].multiThreadLevel);
+    total += threads[i];
+  }
+  if (pool->clampThreads(total) < numStages) {
+    std::cerr << "[[MapReduceFramework]] error on startPipeline: more stages "
+                 "than pool threads"
+              << std::endl;
+    exit(1);
+  }
+  // every stage needs a thread, however small the pipeline's share
+  int bound = std::max(numStages,
+                       pool->reserveThreads(total, weight(stages[0].config)));
+  if (bound < total) {
+    int sum = 0;
+    for (int i = 0; i < numStages; i++) {
+      threads[i] = std::max(1, threads[i] * bound / total);
+      sum += threads[i];
+    }
+    // rounding up to 1 thread may leave the stages over the bound
+    while (sum > bound) {
+      (*std::max_element(threads.begin(), threads.end()))--;
+      sum--;
+    }
+  }
+
+  // the jobs are submitted as one gang, so no stage waits for a stage that
+  // can't start
+  std::vector<WorkerPool::Task> gang;
+  MapReduceJob *job = nullptr;
+  // the pipe the stage maps, null for the first stage
+  Pipe *input = nullptr;
+  for (int i = 0; i < numStages; i++) {
+    Pipe *output = (i == numStages - 1)
+                       ? nullptr
+                       : new Pipe(threads[i + 1] * PIPE_CAPACITY_PER_THREAD);
+    MapReduceJob *stage = new MapReduceJob(
+        *pool, *stages[i].client, inputVec, input,
+        (output == nullptr) ? outputVec : output->unused, threads[i],
+        stages[i].config, &gang);
+    if (job != nullptr) {
+      stage->follow(job, input);
+    }
+    job = stage;
+    input = output;
+  }
+  double gangWeight = weight(stages[0].config);
+  pool->submit(gang, stages[0].config.priority,
+               std::max<size_t>(1, inputVec.size()) / gangWeight, gangWeight);
   return static_cast<JobHandle>(job);
 }
 
@@ -15,23 +126,53 @@ void waitForJob(JobHandle handle) {
   job->join();
 }
 
+int getJobFd(JobHandle handle) {
+  MapReduceJob *job = static_cast<MapReduceJob *>(handle);
+  return job->getFd();
+}
+
 void getJobState(JobHandle handle, JobState *state) {
   MapReduceJob *job = static_cast<MapReduceJob *>(handle);
   state->stage = job->getStage();
   state->percentage = job->getStatePercentage();
 }
 
+void getJobMetrics(JobHandle handle, JobMetrics *metrics) {
+  MapReduceJob *job = static_cast<MapReduceJob *>(handle);
+  job->getMetrics(metrics);
+}
+
 void closeJobHandle(JobHandle handle) {
   MapReduceJob *job = static_cast<MapReduceJob *>(handle);
   delete job;
 }
 
 void emit2(K2 *key, V2 *value, void *context) {
-  MapReduceJob *job = static_cast<MapReduceJob *>(context);
-  job->insert2(key, value);
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  worker->job->insert2(worker, key, value);
 }
 
 void emit3(K3 *key, V3 *value, void *context) {
-  MapReduceJob *job = static_cast<MapReduceJob *>(context);
-  job->insert3(key, value);
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  worker->job->insert3(worker, key, value);
+}
+
+void emit2Batch(const IntermediatePair *pairs, size_t count, void *context) {
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  worker->job->insert2(worker, pairs, count);
+}
+
+void emit3Batch(const OutputPair *pairs, size_t count, void *context) {
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  worker->job->insert3(worker, pairs, count);
+}
+
+void wakeMap(void *item, void *context) {
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  worker->job->wake(worker, item);
+}
+
+void *allocate2(size_t size, void *context) {
+  WorkerContext *worker = static_cast<WorkerContext *>(context);
+  return worker->arena.allocate(size);
 }
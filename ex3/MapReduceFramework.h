@@ -2,8 +2,13 @@
 #define MAPREDUCEFRAMEWORK_H
 
 #include "MapReduceClient.h"
+#include <cstddef> //size_t
+#include <new>     //placement new
+#include <utility> //std::forward
 
 typedef void* JobHandle;
+typedef void* PoolHandle;
+typedef void* MapCacheHandle;
 
 enum stage_t {UNDEFINED_STAGE=0, MAP_STAGE=1, SHUFFLE_STAGE=2, REDUCE_STAGE=3};
 
@@ -12,15 +17,185 @@ typedef struct {
 	float percentage;
 } JobState;
 
+enum phase_t {MAP_PHASE=0, SORT_PHASE=1, SHUFFLE_PHASE=2, REDUCE_PHASE=3,
+	NUM_PHASES=4};
+
+// number of buckets of the group size histogram
+#define GROUP_SIZE_BUCKETS 32
+
+// what a worker thread of a job did so far. times are in seconds, and the
+// times of a phase are added when the worker finishes it
+typedef struct {
+	// time in each phase, waits included, and the thread's CPU time in it
+	double wallTime[NUM_PHASES];
+	double cpuTime[NUM_PHASES];
+	// time waiting for other threads at the barriers between phases
+	double barrierWaitTime;
+	// time waiting for the lock of the input source
+	double lockWaitTime;
+	// input pairs mapped, intermediate pairs left after sorting and
+	// combining, groups reduced and output pairs emitted
+	size_t inputPairs;
+	size_t intermediatePairs;
+	size_t groups;
+	size_t outputPairs;
+	// input pairs whose map output was replayed from the map cache
+	size_t cachedInputs;
+} WorkerMetrics;
+
+typedef struct {
+	std::vector<WorkerMetrics> workers;
+	// time waitForJob waited for the workers
+	double joinWaitTime;
+	// groupSizes[i] is the number of reduced groups of 2^i to 2^(i+1)-1 pairs
+	size_t groupSizes[GROUP_SIZE_BUCKETS];
+	size_t largestGroup;
+} JobMetrics;
+
+// how the threads of a job are pinned to CPUs. compact fills the CPUs of
+// one NUMA node before the next, scatter deals threads round robin across
+// nodes, list pins thread i to cpus[i % numCpus]
+enum affinity_t {NO_AFFINITY=0, COMPACT_AFFINITY=1, SCATTER_AFFINITY=2,
+	LIST_AFFINITY=3};
+
+// optional settings of a job. a zeroed config gives the defaults
+typedef struct {
+	// number of intermediate pairs kept in memory, shared by the threads.
+	// threads over their share spill sorted runs to disk, if the client
+	// spills. 0 for no limit
+	size_t memoryBudget;
+	// directory for spilled runs. null for $TMPDIR or /tmp
+	const char* spillDirectory;
+	// file to write a Chrome trace of the job to (chrome://tracing or
+	// Perfetto) when it's done. null for no tracing. a trace that can't be
+	// written is reported on stderr, and the job is done all the same
+	const char* traceFile;
+	// CPU pinning of the job's threads, for the length of the job. per
+	// thread buffers are allocated by their thread after it's pinned, so
+	// they are placed on its node
+	affinity_t affinity;
+	// CPUs for LIST_AFFINITY
+	const int* cpus;
+	int numCpus;
+	// scheduling on a bounded pool. jobs of higher priority start first,
+	// and jobs of equal priority share the pool by weight (0 for 1), in
+	// proportion to their input pairs when known
+	int priority;
+	double weight;
+	// called with the job and onDoneArg when the job is done, on the job's
+	// last thread. the job's output is ready, but the callback must not wait
+	// for or close the job, its threads finish after it returns
+	void (*onDone)(JobHandle job, void* arg);
+	void* onDoneArg;
+	// map output of the last run of the job, replayed for inputs with the
+	// same fingerprint instead of mapping them (see createMapCache). null
+	// for mapping all inputs
+	MapCacheHandle mapCache;
+	// most maps a thread keeps suspended at a time, for clients that map
+	// asynchronously (see MapReduceClient::mapsAsync). 0 for 64
+	int mapsInFlight;
+} JobConfig;
+
+// a source of input pairs, for input that is not in memory all at once.
+// map threads pull pairs in batches and release each batch once it's mapped,
+// so the source can free or reuse its pairs. calls are serialized by the job,
+// a source doesn't need to be thread safe.
+class InputSource {
+public:
+	virtual ~InputSource() {}
+	// append up to max pairs to batch and return how many were appended.
+	// 0 once the source is exhausted
+	virtual size_t next(InputVec& batch, size_t max) = 0;
+	// the pairs of a batch were mapped
+	virtual void release(const InputVec& batch) {}
+	// number of pairs in the source, for progress. 0 if unknown
+	virtual size_t size() const { return 0; }
+};
+
 void emit2 (K2* key, V2* value, void* context);
 void emit3 (K3* key, V3* value, void* context);
+// emit count pairs at once, with the bookkeeping of a single emit. the
+// pairs are copied, the array may be reused once the call returns
+void emit2Batch (const IntermediatePair* pairs, size_t count, void* context);
+void emit3Batch (const OutputPair* pairs, size_t count, void* context);
+// resume a suspended asynchronous map (see MapReduceClient::mapsAsync) on
+// the thread that started it. may be called from any thread
+void wakeMap (void* item, void* context);
+
+// allocate memory for intermediate keys and values from the arena of the
+// calling thread (context is the one given to map). the memory is freed all
+// at once by closeJobHandle: objects in it are never destroyed and must not
+// be deleted by the client.
+void* allocate2 (size_t size, void* context);
+
+// construct an intermediate key or value in the arena of the calling thread
+template <class T, class... Args>
+T* new2 (void* context, Args&&... args) {
+	return new (allocate2(sizeof(T), context)) T(std::forward<Args>(args)...);
+}
 
 JobHandle startMapReduceJob(const MapReduceClient& client,
 	const InputVec& inputVec, OutputVec& outputVec,
 	int multiThreadLevel);
 
+// create a pool of numThreads workers that stay alive between jobs. the pool
+// grows when a job needs more workers than are idle, up to maxThreads
+// workers (0 for no bound). at the bound jobs wait for their turn (see
+// JobConfig::priority). a job's threads are not taken back while it runs,
+// so a job gets at most its share of maxThreads by weight among the jobs
+// waiting or running when it starts, and no more than the threads free then
+// if there are any. a quarter of maxThreads, at least one thread, is left to
+// the jobs started after it, so they don't wait for it to finish.
+// jobs started without a pool run on a default one, with no bound.
+PoolHandle createWorkerPool(int numThreads, int maxThreads = 0);
+// stop the workers of a pool. all jobs on the pool must be closed first
+void closeWorkerPool(PoolHandle pool);
+
+// create a cache of map output for rerunning a job incrementally. a job
+// given the cache replays the cached pairs of each input whose fingerprint
+// (see MapReduceClient::fingerprint) it has, maps the other inputs and
+// caches their pairs, and drops the inputs it didn't have. jobs using a
+// cache must not run at the same time
+MapCacheHandle createMapCache();
+void closeMapCache(MapCacheHandle cache);
+
+JobHandle startMapReduceJob(PoolHandle pool, const MapReduceClient& client,
+	const InputVec& inputVec, OutputVec& outputVec,
+	int multiThreadLevel, const JobConfig& config = JobConfig());
+
+// start a job reading its input from a source. the source must stay alive
+// until the job is closed
+JobHandle startMapReduceJob(PoolHandle pool, const MapReduceClient& client,
+	InputSource& source, OutputVec& outputVec,
+	int multiThreadLevel, const JobConfig& config = JobConfig());
+
+// a stage of a pipeline (see startPipeline)
+typedef struct {
+	const MapReduceClient* client;
+	int multiThreadLevel;
+	JobConfig config;
+} PipelineStage;
+
+// start a pipeline of jobs, each stage mapping the output of the stage
+// before it as it's reduced, with no output vector in between. the first
+// stage maps inputVec and the last one's output goes to outputVec. objects
+// passed between stages must derive from K1 and K3 or from V1 and V3, and
+// are deleted once they are mapped. the stages run at once on the pool, so
+// on a bounded pool their threads are scaled down to fit the pipeline's
+// share of the bound, and the pipeline takes its turn by the priority and
+// weight of its first stage. returns the job of the last stage: waiting
+// for it waits for the pipeline and closing it closes all stages
+JobHandle startPipeline(PoolHandle pool, const PipelineStage* stages,
+	int numStages, const InputVec& inputVec, OutputVec& outputVec);
+
 void waitForJob(JobHandle job);
+// an eventfd that becomes readable when the job is done, for waiting on many
+// jobs with poll or epoll. it's owned by the job and closed with its handle
+int getJobFd(JobHandle job);
 void getJobState(JobHandle job, JobState* state);
+// a snapshot of the metrics of a job, while it runs or after it's done.
+// metrics are always collected, at a few clock reads per phase
+void getJobMetrics(JobHandle job, JobMetrics* metrics);
 void closeJobHandle(JobHandle job);
 	
 	
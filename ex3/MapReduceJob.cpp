@@ -1,188 +1,1281 @@
 #include "MapReduceJob.h"
+#include "Safe.h"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <random>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
 
-// safe macro for error handling of system calls
-#define SAFE(x)                                                                \
-  if ((x) != 0) {                                                              \
-    std::cerr << "[[MapReduceFramework]] error on " #x << std::endl;           \
-    this->~MapReduceJob();                                                     \
-    exit(1);                                                                   \
+// number of samples taken per key range when choosing the shuffle splitters
+#define SAMPLES_PER_RANGE 8
+// number of pairs sampled to estimate the distinct keys when hashing
+#define KEY_SAMPLE_SIZE 4096
+// number of output pairs from which threads copy their outputs in parallel
+#define PARALLEL_SPLICE_SIZE (1 << 16)
+// the remaining items of a phase are split to this many chunks per thread
+#define CHUNKS_PER_THREAD 2
+// runs of at least this many pairs are radix sorted, if the client
+// normalizes keys
+#define RADIX_SORT_SIZE 256
+// groups over this many pairs may be split, if they are also large compared
+// to the other groups
+#define SPLIT_GROUP_SIZE (1 << 12)
+// number of pairs a map thread pulls from an input source at a time, and a
+// reduce thread pushes to the next stage of a pipeline
+#define INPUT_BATCH_SIZE 256
+// default number of maps a thread keeps suspended, for asynchronous clients
+#define MAPS_IN_FLIGHT 64
+// most spilled runs the threads of a job read at once. a map thread merges
+// its runs when it has more than its share of them, and the runs of all
+// threads are merged before the shuffle until every reduce thread can read
+// all of them
+#define MAX_OPEN_RUNS 256
+
+// system calls of the constructor free the job before exiting on an error.
+// no thread runs the job yet, so there's nothing to join
+#define SAFE_INIT(x) SAFE_OR(x, joined = true; this->~MapReduceJob())
+
+// read a clock, in nanoseconds
+static long long now(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// copy the pairs [begin, end) of a group, in the order it is iterated
+static void copyPairs(const GroupView &group, size_t begin, size_t end,
+                      IntermediateVec &pairs) {
+  size_t offset = 0;
+  for (const PairSpan *span = group.spanBegin();
+       span != group.spanEnd() && offset < end; span++) {
+    size_t size = span->end - span->begin;
+    size_t lo = std::max(begin, offset), hi = std::min(end, offset + size);
+    if (lo < hi) {
+      pairs.insert(pairs.end(), span->begin + (lo - offset),
+                   span->begin + (hi - offset));
+    }
+    offset += size;
+  }
+}
+
+// add to a counter only its own thread writes. no atomic read-modify-write
+// is needed, just a load and store that readers can't see torn
+template <class T> static void add(std::atomic<T> &counter, T value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+WorkerCounters::WorkerCounters()
+    : barrierWaitTime(0), lockWaitTime(0), inputPairs(0),
+      intermediatePairs(0), groups(0), outputPairs(0), cachedInputs(0),
+      largestGroup(0) {
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    wallTime[phase] = 0;
+    cpuTime[phase] = 0;
   }
+  for (int i = 0; i < GROUP_SIZE_BUCKETS; i++) {
+    groupSizes[i] = 0;
+  }
+}
 
-MapReduceJob::MapReduceJob(const MapReduceClient &client,
-                           const InputVec &inputVec, OutputVec &outputVec,
-                           int numThreads)
-    : client(client), inputVec(inputVec), outputVec(outputVec),
-      numThreads(numThreads), threadpool(numThreads), intermediateVectors(numThreads), nextTid(0), counter(0),
-      barrier(numThreads) {
+MapReduceJob::MapReduceJob(WorkerPool &pool, const MapReduceClient &client,
+                           const InputVec &inputVec, InputSource *source,
+                           OutputVec &outputVec, int numThreads,
+                           const JobConfig &config,
+                           std::vector<WorkerPool::Task> *gang)
+    : client(client), inputVec(inputVec), source(source), sourceDone(false),
+      outputVec(outputVec), sink(nullptr), upstream(nullptr), pipe(nullptr),
+      mapCache(client.mapsAsync() ? nullptr
+                                  : static_cast<MapCache *>(config.mapCache)),
+      mapsAsync(client.mapsAsync()),
+      mapsInFlight(config.mapsInFlight > 0 ? config.mapsInFlight
+                                           : MAPS_IN_FLIGHT),
+      numThreads(numThreads), workers(numThreads), spilled(false),
+      hashing(client.hashes()), table(nullptr), tableFull(false),
+      groups(numThreads), groupSpans(numThreads), runs(numThreads),
+      hashedGroups(numThreads), groupOffsets(numThreads + 1),
+      scheduleOffsets(1, 0),
+      outputOffsets(numThreads + 1), joined(false), counter(0), progress(0),
+      intermediateSize(0), barrier(numThreads), finished(0), doneFd(-1),
+      done(false), onDone(config.onDone), onDoneArg(config.onDoneArg),
+      joinWaitTime(0) {
   // set stage to map
   stage = MAP_STAGE;
-  // set input size
-  inputSize = inputVec.size();
-  // create threads
-  for (int i = 0; i < numThreads; i++) {
-    pthread_t thread;
-    SAFE(pthread_create(&thread, nullptr, startThread, this));
+  // set input size, as far as a source knows it
+  inputSize = (source == nullptr) ? inputVec.size() : source->size();
+  // each thread spills over its share of the memory budget
+  size_t spillLimit = 0;
+  if (config.memoryBudget != 0 && client.spills() && !hashing) {
+    spillLimit = std::max<size_t>(1, config.memoryBudget / numThreads);
   }
-
+  const char *dir = config.spillDirectory;
+  if (dir == nullptr) {
+    dir = getenv("TMPDIR") != nullptr ? getenv("TMPDIR") : "/tmp";
+  }
+  spillDirectory = dir;
+  traceFile = (config.traceFile == nullptr) ? "" : config.traceFile;
+  affinity = planAffinity(config.affinity, config.cpus, config.numCpus,
+                          numThreads);
+  startTime = now(CLOCK_MONOTONIC);
   // initialize synchronization objects
-  SAFE(sem_init(&shuffleSem, 0, 0));
-  SAFE(pthread_mutex_init(&outputVecMutex, nullptr));
+  SAFE_INIT(sem_init(&doneSem, 0, 0));
+  SAFE_INIT(pthread_mutex_init(&sourceMutex, nullptr));
+  SAFE_INIT(pthread_mutex_init(&notifyMutex, nullptr));
+  // run on pool workers, each thread with its own context
+  std::vector<WorkerPool::Task> tasks(numThreads);
+  for (int i = 0; i < numThreads; i++) {
+    workers[i].job = this;
+    workers[i].tid = i;
+    workers[i].spilledPairs = 0;
+    workers[i].spillLimit = spillLimit;
+    workers[i].caching = false;
+    workers[i].inFlight = 0;
+    workers[i].finishedItems = 0;
+    SAFE_INIT(pthread_mutex_init(&workers[i].readyMutex, nullptr));
+    SAFE_INIT(pthread_cond_init(&workers[i].readyCv, nullptr));
+    tasks[i] = {startThread, &workers[i]};
+  }
+  // jobs started together are submitted together by the caller
+  if (gang != nullptr) {
+    gang->insert(gang->end(), tasks.begin(), tasks.end());
+    return;
+  }
+  // a job's turn on the pool comes by its size over its weight
+  double weight = (config.weight > 0) ? config.weight : 1;
+  pool.submit(tasks, config.priority,
+              std::max<size_t>(1, inputSize.load()) / weight, weight);
 }
 
 MapReduceJob::~MapReduceJob() {
-  // delete threads
-  if (!joined.load()) { 
-    for (pthread_t& thread : threadpool) {
-      pthread_join(thread, nullptr);
+  // wait for threads, they use the job until they are done
+  if (!joined.load()) {
+    join();
+  }
+  // remove spilled runs
+  for (WorkerContext &worker : workers) {
+    for (SpillRun *run : worker.spillRuns) {
+      delete run;
     }
   }
+  for (K2 *key : splitterCopies) {
+    delete key;
+  }
+  delete table;
+  // the stage before is done writing the pipe once it's joined
+  delete upstream;
+  delete pipe;
   // destroy synchronization objects
-  SAFE(sem_destroy(&shuffleSem));
-  SAFE(pthread_mutex_destroy(&outputVecMutex));
+  for (WorkerContext &worker : workers) {
+    SAFE(pthread_cond_destroy(&worker.readyCv));
+    SAFE(pthread_mutex_destroy(&worker.readyMutex));
+  }
+  SAFE(sem_destroy(&doneSem));
+  SAFE(pthread_mutex_destroy(&sourceMutex));
+  SAFE(pthread_mutex_destroy(&notifyMutex));
+  if (doneFd != -1) {
+    SAFE(close(doneFd));
+  }
 }
 
 void MapReduceJob::run(int tid) {
-  map(tid);
-  sort(tid);
-  shuffle(tid);
-  reduce(tid);
+  void (MapReduceJob::*phases[NUM_PHASES])(int) = {
+      &MapReduceJob::map, &MapReduceJob::sort, &MapReduceJob::shuffle,
+      &MapReduceJob::reduce};
+  const char *names[NUM_PHASES] = {"map", "sort", "shuffle", "reduce"};
+  WorkerCounters &counters = workers[tid].counters;
+  // pin before any per-thread buffer is allocated, so the buffers are on the
+  // thread's node. the pool worker gets its CPU set back after the job.
+  // pinning is a hint, a thread that can't be pinned runs unpinned
+  cpu_set_t previous;
+  bool pinned = !affinity.empty() && pinThread(affinity[tid], &previous) == 0;
+  // each phase is timed from the end of the one before
+  long long wall = now(CLOCK_MONOTONIC);
+  long long cpu = now(CLOCK_THREAD_CPUTIME_ID);
+  for (int phase = 0; phase < NUM_PHASES; phase++) {
+    (this->*phases[phase])(tid);
+    long long wallEnd = now(CLOCK_MONOTONIC);
+    long long cpuEnd = now(CLOCK_THREAD_CPUTIME_ID);
+    add(counters.wallTime[phase], wallEnd - wall);
+    add(counters.cpuTime[phase], cpuEnd - cpu);
+    trace(tid, names[phase], wall);
+    wall = wallEnd;
+    cpu = cpuEnd;
+  }
+  if (pinned) {
+    pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+  }
+  // the last thread notifies before its post, while the job is alive
+  if (finished.fetch_add(1) == numThreads - 1) {
+    notifyDone();
+  }
+  // the job may be deleted once all threads post, so this comes last
+  SAFE(sem_post(&doneSem));
 }
 
 void MapReduceJob::map(int tid) {
-  int index = -1;
-  while ((index = counter.fetch_add(1)) < inputSize.load()) {
-    const InputPair &p = inputVec[index];
-    client.map(p.first, p.second, this);
+  if (source != nullptr) {
+    InputVec batch;
+    while (nextBatch(tid, batch)) {
+      long long start = traceTime();
+      for (const InputPair &p : batch) {
+        mapPair(tid, p);
+      }
+      // the batch is released once its maps are done
+      resumeMaps(tid, 0);
+      trace(tid, "map items", start, batch.size());
+      add(workers[tid].counters.inputPairs, batch.size());
+      lockSource(tid);
+      source->release(batch);
+      SAFE(pthread_mutex_unlock(&sourceMutex));
+    }
+  } else {
+    size_t begin, end;
+    while (claimChunk(inputSize.load(), begin, end)) {
+      long long start = traceTime();
+      for (size_t index = begin; index < end; index++) {
+        mapPair(tid, inputVec[index]);
+      }
+      trace(tid, "map items", start, end - begin);
+      add(workers[tid].counters.inputPairs, end - begin);
+    }
+    resumeMaps(tid, 0);
   }
+  // the rest of the pairs stay in memory
+  workers[tid].spillLimit = 0;
 }
 
 void MapReduceJob::sort(int tid) {
-  // sort by key
-  std::sort(intermediateVectors[tid].begin(), intermediateVectors[tid].end(),
-            [](const IntermediatePair &p1, const IntermediatePair &p2) {
-              return *p1.first < *p2.first;
-            });
+  // grouping by hash needs no order
+  if (!hashing) {
+    sortRun(tid);
+  }
+  // count intermediate pairs
+  size_t pairs =
+      workers[tid].intermediateVec.size() + workers[tid].spilledPairs;
+  intermediateSize.fetch_add(pairs);
+  add(workers[tid].counters.intermediatePairs, pairs);
   // wait for all threads to finish this phase
-  barrier.barrier();
+  waitBarrier(tid);
+  mergeSpilledRuns(tid);
+}
+
+void MapReduceJob::sortRun(int tid) {
+  // sort by key
+  IntermediateVec &vec = workers[tid].intermediateVec;
+  if (client.normalizesKeys() && vec.size() >= RADIX_SORT_SIZE &&
+      vec.size() <= UINT32_MAX) {
+    radixSortRun(tid);
+  } else {
+    std::sort(vec.begin(), vec.end(), PairLess());
+  }
+  if (client.combines()) {
+    combine(tid);
+  }
+}
+
+void MapReduceJob::radixSortRun(int tid) {
+  IntermediateVec &vec = workers[tid].intermediateVec;
+  size_t size = vec.size();
+  std::vector<RadixEntry> entries(size), buffer;
+  for (size_t i = 0; i < size; i++) {
+    entries[i] = {vec[i].first->normalizedKey(), (uint32_t)i};
+  }
+  radixSort(entries, buffer);
+  IntermediateVec sorted(size);
+  for (size_t i = 0; i < size; i++) {
+    sorted[i] = vec[entries[i].index];
+  }
+  // keys with equal normalized keys are ordered by comparing them. the
+  // check first keeps runs of a single key linear
+  for (size_t begin = 0; begin < size;) {
+    size_t end = begin + 1;
+    while (end < size && entries[end].key == entries[begin].key) {
+      end++;
+    }
+    if (end - begin > 1 &&
+        !std::is_sorted(sorted.begin() + begin, sorted.begin() + end,
+                        PairLess())) {
+      std::sort(sorted.begin() + begin, sorted.begin() + end, PairLess());
+    }
+    begin = end;
+  }
+  vec.swap(sorted);
+}
+
+void MapReduceJob::spill(int tid) {
+  WorkerContext &worker = workers[tid];
+  // the combiner emits into the vector being spilled, don't spill again,
+  // and its pairs aren't the map output of the input being cached
+  size_t spillLimit = worker.spillLimit;
+  bool caching = worker.caching;
+  worker.spillLimit = 0;
+  worker.caching = false;
+  sortRun(tid);
+  worker.caching = caching;
+  worker.spillRuns.push_back(
+      new SpillRun(worker.intermediateVec, spillDirectory));
+  worker.spilledPairs += worker.intermediateVec.size();
+  worker.intermediateVec.clear();
+  worker.spillLimit = spillLimit;
+  // bound the runs so the files open at once don't grow with the input
+  size_t maxRuns = std::max(2, MAX_OPEN_RUNS / numThreads);
+  if (worker.spillRuns.size() > maxRuns) {
+    mergeRuns(tid, maxRuns);
+  }
+}
+
+void MapReduceJob::mergeRuns(int tid, size_t width) {
+  std::vector<SpillRun *> &spillRuns = workers[tid].spillRuns;
+  // merging the smallest runs rewrites each pair a logarithmic number of
+  // times, rather than once per merge
+  std::vector<SpillRun *> bySize(spillRuns);
+  std::stable_sort(bySize.begin(), bySize.end(),
+                   [](const SpillRun *r1, const SpillRun *r2) {
+                     return r1->size() < r2->size();
+                   });
+  bySize.resize(width);
+  std::vector<SpillRun *> merged, kept;
+  for (SpillRun *run : spillRuns) {
+    bool small = std::find(bySize.begin(), bySize.end(), run) != bySize.end();
+    (small ? merged : kept).push_back(run);
+  }
+  long long start = traceTime();
+  kept.push_back(new SpillRun(merged, client, spillDirectory));
+  trace(tid, "merge spilled runs", start, merged.size());
+  for (SpillRun *run : merged) {
+    delete run;
+  }
+  spillRuns.swap(kept);
+}
+
+void MapReduceJob::mergeSpilledRuns(int tid) {
+  std::vector<SpillRun *> all;
+  for (const WorkerContext &worker : workers) {
+    all.insert(all.end(), worker.spillRuns.begin(), worker.spillRuns.end());
+  }
+  // every reduce thread reads every run
+  size_t maxRuns = std::max(1, MAX_OPEN_RUNS / numThreads);
+  if (all.size() <= maxRuns) {
+    return;
+  }
+  // consecutive runs are merged in groups, group i by thread i % numThreads
+  size_t width = (all.size() + maxRuns - 1) / maxRuns;
+  size_t numGroups = (all.size() + width - 1) / width;
+  std::vector<SpillRun *> merged, inputs;
+  for (size_t group = tid; group < numGroups; group += numThreads) {
+    auto first = all.begin() + group * width;
+    std::vector<SpillRun *> runs(
+        first, first + std::min(width, all.size() - group * width));
+    if (runs.size() == 1) {
+      merged.push_back(runs[0]);
+      continue;
+    }
+    long long start = traceTime();
+    merged.push_back(new SpillRun(runs, client, spillDirectory));
+    trace(tid, "merge spilled runs", start, runs.size());
+    inputs.insert(inputs.end(), runs.begin(), runs.end());
+  }
+  // the runs of other threads are replaced once no thread reads them
+  waitBarrier(tid);
+  for (SpillRun *run : inputs) {
+    delete run;
+  }
+  workers[tid].spillRuns.swap(merged);
+  waitBarrier(tid);
+}
+
+void MapReduceJob::combine(int tid) {
+  // take the sorted run, emits from the combiner go to a fresh one. since
+  // combined pairs keep their key, the new run is sorted as well
+  IntermediateVec run;
+  run.swap(workers[tid].intermediateVec);
+  IntermediateVec group;
+  for (auto begin = run.begin(); begin != run.end();) {
+    auto end = begin + 1;
+    while (end != run.end() && !(*begin->first < *end->first)) {
+      ++end;
+    }
+    if (end - begin == 1) {
+      // nothing to fold
+      workers[tid].intermediateVec.push_back(*begin);
+    } else {
+      group.assign(begin, end);
+      client.combine(&group, &workers[tid]);
+    }
+    begin = end;
+  }
 }
 
 void MapReduceJob::shuffle(int tid) {
-  if (tid != 0) {
-    // wait for thread 0 to finish shuffling
-    SAFE(sem_wait(&shuffleSem));
+  if (tid == 0) {
+    // set stage (thread safe, only thread 0 writes) and reset counters
+    stage = SHUFFLE_STAGE;
+    counter.store(0);
+    resetProgress();
+    for (const WorkerContext &worker : workers) {
+      spilled = spilled || !worker.spillRuns.empty();
+    }
+    // all threads are done looking up the map cache
+    if (mapCache != nullptr) {
+      updateCache();
+    }
+    if (hashing) {
+      // a table for every pair may be far larger than the keys need, it's
+      // only built if the estimate turns out too small
+      table = new GroupTable(estimateKeys());
+    } else {
+      // split the keys to one range per thread
+      sampleSplitters();
+    }
+    if (spilled) {
+      // groups are reduced as they are merged, there's nothing to claim
+      stage = REDUCE_STAGE;
+      outputSize = 0;
+    }
+  }
+  // wait for splitters
+  waitBarrier(tid);
+
+  if (spilled) {
+    streamRange(tid);
+    return;
+  }
+
+  if (hashing) {
+    hashGroups(tid);
   } else {
-    // horizontal shuffle across all pairs
-    shuffle();
-    // wake up all threads
-    for (int i = 0; i < numThreads - 1; i++) {
-      SAFE(sem_post(&shuffleSem));
+    // find the slice of each intermediate vector that is in this thread's
+    // range. slices are merged from their largest key down
+    auto keyLess = [](const IntermediatePair &p, K2 *key) {
+      return *p.first < *key;
+    };
+    std::vector<SliceMerge::Run> slices(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+      IntermediateVec &vec = workers[i].intermediateVec;
+      auto lo = (tid == 0) ? vec.begin()
+                           : std::lower_bound(vec.begin(), vec.end(),
+                                              splitters[tid - 1], keyLess);
+      auto hi = (tid == numThreads - 1)
+                    ? vec.end()
+                    : std::lower_bound(lo, vec.end(), splitters[tid], keyLess);
+      slices[i] = {IntermediateVec::reverse_iterator(hi),
+                   IntermediateVec::reverse_iterator(lo)};
+    }
+
+    SliceMerge merge(slices, [](const IntermediatePair &p1,
+                                const IntermediatePair &p2) {
+      return *p2.first < *p1.first;
+    });
+    // iterate over all pairs in range across all threads, ordered by key.
+    // a group is the spans of its key in the runs, the pairs stay in place
+    std::vector<PairSpan> &spans = groupSpans[tid];
+    std::vector<size_t> spanEnds;
+    while (!merge.empty()) {
+      size_t size = 0;
+      merge.skipEqual([&spans, &size](IntermediateVec::reverse_iterator first,
+                                      IntermediateVec::reverse_iterator last) {
+        // the reversed range [first, last) is [&*(last - 1), &*first] forward
+        spans.push_back({&*(last - 1), &*first + 1});
+        size += last - first;
+      });
+      spanEnds.push_back(spans.size());
+      progress.fetch_add(size);
     }
+    viewGroups(tid, spanEnds);
+  }
+  // wait for all ranges to be grouped
+  waitBarrier(tid);
+  // a sorted run is kept for the groups viewing it, hashed pairs are all in
+  // groups now. either way emits of combine go to an empty vector
+  if (hashing) {
+    IntermediateVec().swap(workers[tid].intermediateVec);
+  } else {
+    runs[tid].swap(workers[tid].intermediateVec);
   }
+
+  if (tid == 0) {
+    delete table;
+    table = nullptr;
+    // index the groups from the highest key range down, so groups are ordered
+    // by descending key like a single pass over all threads would order them
+    groupOffsets[0] = 0;
+    for (int k = 0; k < numThreads; k++) {
+      groupOffsets[k + 1] = groupOffsets[k] + groups[numThreads - 1 - k].size();
+    }
+    // set output size
+    outputSize = groupOffsets[numThreads];
+    splitGroups();
+    // split groups are scheduled once their parts are combined
+    if (parts.empty()) {
+      scheduleGroups();
+    }
+    // set stage and reset counters
+    stage = REDUCE_STAGE;
+    counter.store(0);
+    resetProgress();
+  }
+  // wait for reduce stage
+  waitBarrier(tid);
 }
 
 void MapReduceJob::reduce(int tid) {
-  int index = -1;
-  while ((index = counter.fetch_add(1)) < outputSize.load()) {
-    client.reduce(&intermediateVectors[index], this);
+  if (!parts.empty()) {
+    combineParts(tid);
+  }
+  size_t begin, end;
+  while (claimGroups(begin, end)) {
+    long long start = traceTime();
+    for (size_t index = begin; index < end; index++) {
+      GroupView &group = getGroup(schedule[index]);
+      countGroup(tid, group.size());
+      client.reduceGroup(&group, &workers[tid]);
+      add(workers[tid].finishedItems, (size_t)1);
+    }
+    trace(tid, "reduce groups", start, end - begin);
+  }
+  if (sink != nullptr) {
+    sink->push(workers[tid].outputVec);
   }
+  // wait for all outputs
+  waitBarrier(tid);
+  // memory runs of a spilled job are reduced by now, and so are all groups
+  IntermediateVec().swap(workers[tid].intermediateVec);
+  IntermediateVec().swap(runs[tid]);
+  std::vector<IntermediateVec>().swap(hashedGroups[tid]);
+  std::vector<PairSpan>().swap(groupSpans[tid]);
+  std::vector<GroupView>().swap(groups[tid]);
+
+  if (tid == 0) {
+    if (sink != nullptr) {
+      sink->close();
+    }
+    std::vector<GroupPart>().swap(parts);
+    std::vector<PairSpan>().swap(partSpans);
+    // find where each thread's output goes
+    outputOffsets[0] = outputVec.size();
+    for (int i = 0; i < numThreads; i++) {
+      outputOffsets[i + 1] = outputOffsets[i] + workers[i].outputVec.size();
+    }
+    if (outputOffsets[numThreads] - outputOffsets[0] < PARALLEL_SPLICE_SIZE) {
+      // small outputs are appended by thread 0 alone
+      for (WorkerContext &worker : workers) {
+        outputVec.insert(outputVec.end(), worker.outputVec.begin(),
+                         worker.outputVec.end());
+        OutputVec().swap(worker.outputVec);
+      }
+    } else {
+      outputVec.resize(outputOffsets[numThreads]);
+    }
+  }
+  // wait for outputVec to be sized
+  waitBarrier(tid);
+
+  // copy this thread's output into its place, unless it was appended
+  OutputVec &threadVec = workers[tid].outputVec;
+  if (!threadVec.empty()) {
+    std::copy(threadVec.begin(), threadVec.end(),
+              outputVec.begin() + outputOffsets[tid]);
+    OutputVec().swap(threadVec);
+  }
+}
+
+void MapReduceJob::mapPair(int tid, const InputPair &pair) {
+  WorkerContext &worker = workers[tid];
+  if (mapsAsync) {
+    // a suspended map counts as finished once it's done
+    if (client.mapAsync(pair.first, pair.second, &worker) != nullptr) {
+      worker.inFlight++;
+    } else {
+      add(worker.finishedItems, (size_t)1);
+    }
+    // resume the maps woken so far, and wait if there's no room for more
+    resumeMaps(tid, mapsInFlight - 1);
+    return;
+  }
+  if (mapCache == nullptr) {
+    client.map(pair.first, pair.second, &worker);
+    add(worker.finishedItems, (size_t)1);
+    return;
+  }
+  uint64_t fingerprint = client.fingerprint(pair.first, pair.second);
+  const MapCache::Entry *entry = mapCache->find(fingerprint);
+  if (entry != nullptr) {
+    std::istringstream in(entry->pairs);
+    for (size_t i = 0; i < entry->numPairs; i++) {
+      IntermediatePair cached = client.deserialize(in);
+      insert2(&worker, cached.first, cached.second);
+    }
+    worker.cacheHits.push_back(fingerprint);
+    add(worker.counters.cachedInputs, (size_t)1);
+    add(worker.finishedItems, (size_t)1);
+    return;
+  }
+  worker.caching = true;
+  worker.cachePairs.str("");
+  worker.numCachePairs = 0;
+  client.map(pair.first, pair.second, &worker);
+  worker.caching = false;
+  worker.cacheMisses.push_back(
+      {fingerprint, {worker.cachePairs.str(), worker.numCachePairs, 0}});
+  add(worker.finishedItems, (size_t)1);
+}
+
+void MapReduceJob::resumeMaps(int tid, size_t limit) {
+  WorkerContext &worker = workers[tid];
+  if (!mapsAsync) {
+    return;
+  }
+  std::vector<void *> items;
+  do {
+    SAFE(pthread_mutex_lock(&worker.readyMutex));
+    while (worker.ready.empty() && worker.inFlight > limit) {
+      SAFE(pthread_cond_wait(&worker.readyCv, &worker.readyMutex));
+    }
+    items.swap(worker.ready);
+    SAFE(pthread_mutex_unlock(&worker.readyMutex));
+    for (void *item : items) {
+      if (client.resumeMap(item, &worker) == nullptr) {
+        worker.inFlight--;
+        add(worker.finishedItems, (size_t)1);
+      }
+    }
+    items.clear();
+  } while (worker.inFlight > limit);
 }
 
-K2 *MapReduceJob::findMaxKey() {
-  K2 *max = nullptr;
-  for (const IntermediateVec &vec : intermediateVectors) {
-    if (!vec.empty() && (max == nullptr || *max < *vec.back().first)) {
-      max = vec.back().first;
+void MapReduceJob::updateCache() {
+  for (WorkerContext &worker : workers) {
+    for (uint64_t fingerprint : worker.cacheHits) {
+      mapCache->touch(fingerprint);
     }
+    for (std::pair<uint64_t, MapCache::Entry> &miss : worker.cacheMisses) {
+      mapCache->add(miss.first, miss.second);
+    }
+    std::vector<uint64_t>().swap(worker.cacheHits);
+    std::vector<std::pair<uint64_t, MapCache::Entry>>().swap(
+        worker.cacheMisses);
+    worker.cachePairs.str("");
   }
-  return max;
+  mapCache->finishRun();
 }
 
-void MapReduceJob::shuffle() {
-  // set stage (thread safe, only thread 0 writes) and reset counter
-  stage = SHUFFLE_STAGE;
-  counter.store(0);
+bool MapReduceJob::nextBatch(int tid, InputVec &batch) {
+  batch.clear();
+  lockSource(tid);
+  // a source isn't asked again once it ran out
+  if (!sourceDone) {
+    sourceDone = (source->next(batch, INPUT_BATCH_SIZE) == 0);
+  }
+  SAFE(pthread_mutex_unlock(&sourceMutex));
+  return !batch.empty();
+}
 
-  K2 *key = nullptr;
-  std::vector<IntermediateVec> result;
-  // iterate over all pairs across all threads, ordered by key
-  while ((key = findMaxKey()) != nullptr) {
-    IntermediateVec resultVec;
-    // insert all pairs with the same key to vec
-    for (int i = 0; i < numThreads; i++) {
-      IntermediateVec &threadVec = intermediateVectors[i];
-      while (!(threadVec.empty() || *threadVec.back().first < *key ||
-               *key < *threadVec.back().first)) {
-        resultVec.push_back(threadVec.back());
-        threadVec.pop_back();
+void MapReduceJob::waitBarrier(int tid) {
+  long long start = now(CLOCK_MONOTONIC);
+  barrier.barrier();
+  add(workers[tid].counters.barrierWaitTime, now(CLOCK_MONOTONIC) - start);
+  trace(tid, "barrier wait", start);
+}
+
+void MapReduceJob::lockSource(int tid) {
+  long long start = now(CLOCK_MONOTONIC);
+  SAFE(pthread_mutex_lock(&sourceMutex));
+  add(workers[tid].counters.lockWaitTime, now(CLOCK_MONOTONIC) - start);
+  trace(tid, "source lock wait", start);
+}
+
+void MapReduceJob::countGroup(int tid, size_t size) {
+  WorkerCounters &counters = workers[tid].counters;
+  add(counters.groups, (size_t)1);
+  int bucket = 0;
+  while (bucket < GROUP_SIZE_BUCKETS - 1 && (size >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+  add(counters.groupSizes[bucket], (size_t)1);
+  if (size > counters.largestGroup.load(std::memory_order_relaxed)) {
+    counters.largestGroup.store(size, std::memory_order_relaxed);
+  }
+}
+
+void MapReduceJob::trace(int tid, const char *name, long long begin,
+                         size_t items) {
+  if (!traceFile.empty()) {
+    workers[tid].trace.push_back({name, begin, now(CLOCK_MONOTONIC), items});
+  }
+}
+
+long long MapReduceJob::traceTime() {
+  return traceFile.empty() ? 0 : now(CLOCK_MONOTONIC);
+}
+
+void MapReduceJob::writeTrace() {
+  std::ofstream out(traceFile);
+  out << std::fixed << std::setprecision(3);
+  // complete events ("X") of one process, a row per thread. times in
+  // microseconds since the job started
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for (const WorkerContext &worker : workers) {
+    for (const TraceEvent &event : worker.trace) {
+      out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+          << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << worker.tid
+          << ",\"ts\":" << (event.begin - startTime) / 1000.0
+          << ",\"dur\":" << (event.end - event.begin) / 1000.0;
+      if (event.items != 0) {
+        out << ",\"args\":{\"items\":" << event.items << "}";
+      }
+      out << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  // the job is done fine without its trace, so this only reports
+  if (!out) {
+    std::cerr << "[[MapReduceFramework]] error on writing " << traceFile
+              << std::endl;
+  }
+}
+
+bool MapReduceJob::claimGroups(size_t &begin, size_t &end) {
+  size_t size = schedule.size();
+  size_t total = scheduleOffsets[size];
+  begin = counter.load();
+  do {
+    if (begin >= size) {
+      return false;
+    }
+    // guided by pairs: a share of the remaining pairs, so a large group is
+    // claimed alone and small ones in bulk
+    size_t target =
+        scheduleOffsets[begin] +
+        std::max<size_t>(1, (total - scheduleOffsets[begin]) /
+                                (numThreads * CHUNKS_PER_THREAD));
+    end = std::upper_bound(scheduleOffsets.begin() + begin + 1,
+                           scheduleOffsets.end(), target) -
+          scheduleOffsets.begin() - 1;
+    end = std::max(end, begin + 1);
+  } while (!counter.compare_exchange_weak(begin, end));
+  return true;
+}
+
+void MapReduceJob::splitGroups() {
+  parts.clear();
+  if (!client.associative() || numThreads == 1) {
+    return;
+  }
+  // a group is oversized when it's more than a share of a thread's pairs
+  size_t partSize = std::max<size_t>(
+      SPLIT_GROUP_SIZE,
+      intermediateSize.load() / (numThreads * CHUNKS_PER_THREAD));
+  for (int index = 0; index < (int)outputSize.load(); index++) {
+    size_t size = getGroup(index).size();
+    if (size <= partSize) {
+      continue;
+    }
+    for (size_t begin = 0; begin < size; begin += partSize) {
+      parts.push_back({index, begin, std::min(size, begin + partSize),
+                       IntermediateVec()});
+    }
+  }
+}
+
+void MapReduceJob::combineParts(int tid) {
+  // one part at a time, parts are large
+  size_t index;
+  while ((index = counter.fetch_add(1)) < parts.size()) {
+    long long start = traceTime();
+    GroupPart &part = parts[index];
+    IntermediateVec pairs;
+    copyPairs(getGroup(part.group), part.begin, part.end, pairs);
+    // emits go to the thread's intermediate vector, empty since the shuffle
+    client.combine(&pairs, &workers[tid]);
+    part.result.swap(workers[tid].intermediateVec);
+    trace(tid, "combine group part", start, pairs.size());
+  }
+  // wait for all parts
+  waitBarrier(tid);
+
+  if (tid == 0) {
+    // a split group is a view of its combined parts. reserved, so the spans
+    // don't move while they are viewed
+    partSpans.reserve(parts.size());
+    size_t begin = 0;
+    while (begin < parts.size()) {
+      const PairSpan *first = partSpans.data() + partSpans.size();
+      size_t size = 0;
+      size_t end = begin;
+      for (; end < parts.size() && parts[end].group == parts[begin].group;
+           end++) {
+        IntermediateVec &result = parts[end].result;
+        if (!result.empty()) {
+          partSpans.push_back({result.data(), result.data() + result.size()});
+          size += result.size();
+        }
+      }
+      getGroup(parts[begin].group) =
+          GroupView(first, partSpans.data() + partSpans.size(), size);
+      begin = end;
+    }
+    scheduleGroups();
+    counter.store(0);
+  }
+  // wait for the schedule
+  waitBarrier(tid);
+}
+
+void MapReduceJob::scheduleGroups() {
+  // largest first, by the power of two of the size. exact order within a
+  // power of two doesn't matter for balance, and bucketing is linear
+  int size = outputSize.load();
+  std::vector<int> bucketOffsets(GROUP_SIZE_BUCKETS + 1, 0);
+  std::vector<int> buckets(size);
+  for (int index = 0; index < size; index++) {
+    size_t pairs = getGroup(index).size();
+    int bucket = GROUP_SIZE_BUCKETS - 1;
+    while (bucket > 0 && (pairs >> (GROUP_SIZE_BUCKETS - bucket)) != 0) {
+      bucket--;
+    }
+    buckets[index] = bucket;
+    bucketOffsets[bucket + 1]++;
+  }
+  for (int bucket = 0; bucket < GROUP_SIZE_BUCKETS; bucket++) {
+    bucketOffsets[bucket + 1] += bucketOffsets[bucket];
+  }
+  schedule.resize(size);
+  for (int index = 0; index < size; index++) {
+    schedule[bucketOffsets[buckets[index]]++] = index;
+  }
+  scheduleOffsets.resize(size + 1);
+  scheduleOffsets[0] = 0;
+  for (int i = 0; i < size; i++) {
+    scheduleOffsets[i + 1] = scheduleOffsets[i] + getGroup(schedule[i]).size();
+  }
+}
+
+bool MapReduceJob::claimChunk(size_t size, size_t &begin, size_t &end) {
+  begin = counter.load();
+  size_t chunk;
+  do {
+    if (begin >= size) {
+      return false;
+    }
+    // guided chunks: a share of the remaining items, so chunks shrink toward
+    // the end and no thread is left with a long tail
+    chunk = std::max<size_t>(1, (size - begin) /
+                                    (numThreads * CHUNKS_PER_THREAD));
+  } while (!counter.compare_exchange_weak(begin, begin + chunk));
+  end = begin + chunk;
+  return true;
+}
+
+void MapReduceJob::hashGroups(int tid) {
+  // count the pairs of each key
+  IntermediateVec &vec = workers[tid].intermediateVec;
+  std::vector<size_t> &pairSlots = workers[tid].pairSlots;
+  pairSlots.resize(vec.size());
+  while (true) {
+    for (size_t i = 0; i < vec.size() && !tableFull.load(); i++) {
+      pairSlots[i] = table->insert(vec[i].first);
+      if (pairSlots[i] == GroupTable::FULL) {
+        tableFull = true;
+      }
+    }
+    // wait for all keys to be counted
+    waitBarrier(tid);
+    if (!tableFull.load()) {
+      break;
+    }
+    // the estimate was too small. count again in a table with room for
+    // every pair, once all threads saw the table is full
+    waitBarrier(tid);
+    if (tid == 0) {
+      delete table;
+      table = new GroupTable(intermediateSize.load());
+      tableFull = false;
+    }
+    waitBarrier(tid);
+  }
+
+  // make room for the groups in this thread's share of the table. the share
+  // of thread tid is numbered like a key range, highest range first
+  std::vector<IntermediateVec> &result = hashedGroups[tid];
+  size_t share = table->capacity() / numThreads + 1;
+  size_t begin = std::min(table->capacity(), (numThreads - 1 - tid) * share);
+  size_t end = std::min(table->capacity(), begin + share);
+  for (size_t slot = begin; slot < end; slot++) {
+    int count = table->count(slot);
+    if (count != 0) {
+      table->setGroup(slot, result.size());
+      result.emplace_back(count);
+    }
+  }
+  // each group is a single span of its vector
+  std::vector<size_t> spanEnds;
+  for (IntermediateVec &group : result) {
+    groupSpans[tid].push_back({group.data(), group.data() + group.size()});
+    spanEnds.push_back(groupSpans[tid].size());
+  }
+  viewGroups(tid, spanEnds);
+  // wait for all groups to be sized
+  waitBarrier(tid);
+
+  // move each pair to its place in its group
+  for (size_t i = 0; i < vec.size(); i++) {
+    size_t slot = pairSlots[i];
+    hashedGroups[numThreads - 1 - slot / share][table->getGroup(slot)]
+          [table->take(slot)] = vec[i];
+  }
+  progress.fetch_add(vec.size());
+  std::vector<size_t>().swap(pairSlots);
+}
+
+void MapReduceJob::streamRange(int tid) {
+  K2 *lo = (tid == 0) ? nullptr : splitters[tid - 1];
+  K2 *hi = (tid == numThreads - 1) ? nullptr : splitters[tid];
+  auto keyLess = [](const IntermediatePair &p, K2 *key) {
+    return *p.first < *key;
+  };
+  // cursors over the range in every memory and spilled run
+  std::vector<RunMerge::Run> runs;
+  for (WorkerContext &worker : workers) {
+    IntermediateVec &vec = worker.intermediateVec;
+    auto begin = (lo == nullptr)
+                     ? vec.begin()
+                     : std::lower_bound(vec.begin(), vec.end(), lo, keyLess);
+    auto end = (hi == nullptr)
+                   ? vec.end()
+                   : std::lower_bound(begin, vec.end(), hi, keyLess);
+    runs.push_back({RunCursor(vec.data() + (begin - vec.begin()),
+                              vec.data() + (end - vec.begin())),
+                    RunCursor()});
+    for (SpillRun *run : worker.spillRuns) {
+      runs.push_back({RunCursor(*run, client, lo, hi), RunCursor()});
+    }
+  }
+  // memory runs are searched before any thread reduces, reduce deletes keys
+  waitBarrier(tid);
+
+  long long start = traceTime();
+  RunMerge merge(runs, PairLess());
+  IntermediateVec group;
+  size_t numGroups = 0;
+  while (!merge.empty()) {
+    group.clear();
+    merge.popEqual(group);
+    countGroup(tid, group.size());
+    PairSpan span = {group.data(), group.data() + group.size()};
+    GroupView view(&span, &span + 1, group.size());
+    client.reduceGroup(&view, &workers[tid]);
+    progress.fetch_add(group.size());
+    numGroups++;
+  }
+  trace(tid, "merge and reduce groups", start, numGroups);
+}
+
+void MapReduceJob::sampleSplitters() {
+  // sample evenly across all pairs, so ranges get similar numbers of pairs.
+  // a sample is a key and the number of pairs it stands for. keys of spilled
+  // runs are sampled from their indexes
+  struct Sample {
+    const IntermediatePair *pair;
+    K2 *key;
+    size_t weight;
+  };
+  size_t total = intermediateSize.load();
+  size_t stride =
+      std::max<size_t>(1, total / (numThreads * SAMPLES_PER_RANGE));
+  std::vector<Sample> samples;
+  for (const WorkerContext &worker : workers) {
+    const IntermediateVec &vec = worker.intermediateVec;
+    for (size_t i = 0; i < vec.size(); i += stride) {
+      samples.push_back({&vec[i], vec[i].first, stride});
+    }
+    for (const SpillRun *run : worker.spillRuns) {
+      const std::vector<SpillRun::IndexEntry> &index = run->getIndex();
+      for (size_t i = 0; i < index.size(); i++) {
+        size_t next = (i + 1 < index.size()) ? index[i + 1].pair : run->size();
+        samples.push_back({nullptr, index[i].key, next - index[i].pair});
       }
     }
-    counter.fetch_add(resultVec.size());
-    result.push_back(resultVec);
   }
-  // update intermediate vectors
-  intermediateVectors = result;
-  // set output size
-  outputSize = intermediateVectors.size();
-  // set stage and reset counter
-  stage = REDUCE_STAGE;
-  counter.store(0);
+  std::sort(samples.begin(), samples.end(),
+            [](const Sample &s1, const Sample &s2) {
+              return *s1.key < *s2.key;
+            });
+  size_t weight = 0;
+  for (const Sample &sample : samples) {
+    weight += sample.weight;
+  }
+
+  splitters.clear();
+  size_t cumulative = 0;
+  auto sample = samples.begin();
+  for (int i = 1; i < numThreads; i++) {
+    // with no pairs the splitters are never compared
+    if (samples.empty()) {
+      splitters.push_back(nullptr);
+      continue;
+    }
+    // the first sample past the i-th share of the weight
+    while (sample + 1 != samples.end() &&
+           cumulative + sample->weight <= i * weight / numThreads) {
+      cumulative += sample->weight;
+      ++sample;
+    }
+    K2 *key = sample->key;
+    if (spilled && sample->pair != nullptr) {
+      key = copyKey(*sample->pair);
+      splitterCopies.push_back(key);
+    }
+    splitters.push_back(key);
+  }
 }
 
-int MapReduceJob::currentTid() {
-  pthread_t t = pthread_self();
-  auto it = std::find(threadpool.begin(), threadpool.end(), t);
-  return it - threadpool.begin();
+size_t MapReduceJob::estimateKeys() {
+  struct KeyHash {
+    size_t operator()(const K2 *key) const { return key->hash(); }
+  };
+  struct KeyEqual {
+    bool operator()(const K2 *k1, const K2 *k2) const {
+      return k1->equals(*k2);
+    }
+  };
+  // the number of times each sampled key was sampled
+  std::unordered_map<const K2 *, size_t, KeyHash, KeyEqual> counts;
+  // pairs are sampled at random, keys often repeat at a regular stride
+  size_t total = intermediateSize.load();
+  std::minstd_rand random;
+  size_t sampled = 0;
+  for (const WorkerContext &worker : workers) {
+    const IntermediateVec &vec = worker.intermediateVec;
+    if (vec.empty()) {
+      continue;
+    }
+    size_t samples = std::max<size_t>(
+        1, std::min(vec.size(), vec.size() * KEY_SAMPLE_SIZE / total));
+    std::uniform_int_distribution<size_t> index(0, vec.size() - 1);
+    for (size_t i = 0; i < samples; i++) {
+      counts[vec[index(random)].first]++;
+      sampled++;
+    }
+  }
+  if (sampled == 0) {
+    return 0;
+  }
+  // unseen keys are estimated from the keys sampled once and twice, by the
+  // larger of the guaranteed-error and Chao1 estimators. the first does
+  // better on long tails of rare keys, the second on keys of similar counts
+  size_t once = 0, twice = 0;
+  for (const auto &count : counts) {
+    once += (count.second == 1);
+    twice += (count.second == 2);
+  }
+  double gee = std::sqrt((double)total / sampled) * once;
+  double chao = once * (once - 1.0) / (2 * (twice + 1));
+  double unseen = std::max(gee - once, chao);
+  return std::min<size_t>(total, counts.size() + (size_t)unseen);
 }
 
-void MapReduceJob::insert2(K2 *key, V2 *value) {
-  int tid = currentTid();
+K2 *MapReduceJob::copyKey(const IntermediatePair &pair) {
+  std::stringstream buffer;
+  pair.first->serialize(buffer);
+  pair.second->serialize(buffer);
+  IntermediatePair copy = client.deserialize(buffer);
+  delete copy.second;
+  return copy.first;
+}
+
+void MapReduceJob::viewGroups(int tid, const std::vector<size_t> &spanEnds) {
+  const std::vector<PairSpan> &spans = groupSpans[tid];
+  size_t begin = 0;
+  for (size_t end : spanEnds) {
+    size_t size = 0;
+    for (size_t i = begin; i < end; i++) {
+      size += spans[i].end - spans[i].begin;
+    }
+    groups[tid].emplace_back(spans.data() + begin, spans.data() + end, size);
+    begin = end;
+  }
+}
+
+GroupView &MapReduceJob::getGroup(int index) {
+  // find the range containing the group, skipping empty ranges
+  int k = std::upper_bound(groupOffsets.begin(), groupOffsets.end(), index) -
+          groupOffsets.begin() - 1;
+  return groups[numThreads - 1 - k][index - groupOffsets[k]];
+}
+
+void MapReduceJob::insert2(WorkerContext *worker, K2 *key, V2 *value) {
+  // cache the pair before a spill deletes it
+  if (worker->caching) {
+    key->serialize(worker->cachePairs);
+    value->serialize(worker->cachePairs);
+    worker->numCachePairs++;
+  }
   // insert pair to intermediate vector (thread-safe, each thread has its own)
-  intermediateVectors[tid].push_back(IntermediatePair(key, value));
-  // count intermediate pairs
-  intermediateSize.fetch_add(1);
+  worker->intermediateVec.push_back(IntermediatePair(key, value));
+  // spill when over the thread's share of the memory budget
+  if (worker->spillLimit != 0 &&
+      worker->intermediateVec.size() >= worker->spillLimit) {
+    spill(worker->tid);
+  }
 }
 
-void MapReduceJob::insert3(K3 *key, V3 *value) {
-  // lock output vector mutex
-  SAFE(pthread_mutex_lock(&outputVecMutex));
-  // insert pair to output vector
-  outputVec.push_back(OutputPair(key, value));
-  // unlock output vector mutex
-  SAFE(pthread_mutex_unlock(&outputVecMutex));
+void MapReduceJob::insert3(WorkerContext *worker, K3 *key, V3 *value) {
+  // insert pair to the thread's output vector, spliced into outputVec after
+  // the reduce phase
+  worker->outputVec.push_back(OutputPair(key, value));
+  add(worker->counters.outputPairs, (size_t)1);
+  // or streamed to the next stage of a pipeline, a batch at a time
+  if (sink != nullptr && worker->outputVec.size() >= INPUT_BATCH_SIZE) {
+    sink->push(worker->outputVec);
+  }
 }
 
-void *MapReduceJob::startThread(void *arg) {
-  MapReduceJob *job = static_cast<MapReduceJob *>(arg);
-  // create thread id
-  int tid = job->nextTid.fetch_add(1);
-  // store in threadpool
-  job->threadpool[tid] = pthread_self();
+void MapReduceJob::insert2(WorkerContext *worker,
+                           const IntermediatePair *pairs, size_t count) {
+  if (worker->caching) {
+    for (size_t i = 0; i < count; i++) {
+      pairs[i].first->serialize(worker->cachePairs);
+      pairs[i].second->serialize(worker->cachePairs);
+    }
+    worker->numCachePairs += count;
+  }
+  worker->intermediateVec.insert(worker->intermediateVec.end(), pairs,
+                                 pairs + count);
+  // a batch may take the thread over its share, it spills whole
+  if (worker->spillLimit != 0 &&
+      worker->intermediateVec.size() >= worker->spillLimit) {
+    spill(worker->tid);
+  }
+}
+
+void MapReduceJob::insert3(WorkerContext *worker, const OutputPair *pairs,
+                           size_t count) {
+  worker->outputVec.insert(worker->outputVec.end(), pairs, pairs + count);
+  add(worker->counters.outputPairs, count);
+  if (sink != nullptr && worker->outputVec.size() >= INPUT_BATCH_SIZE) {
+    sink->push(worker->outputVec);
+  }
+}
+
+void MapReduceJob::wake(WorkerContext *worker, void *item) {
+  SAFE(pthread_mutex_lock(&worker->readyMutex));
+  worker->ready.push_back(item);
+  SAFE(pthread_cond_signal(&worker->readyCv));
+  SAFE(pthread_mutex_unlock(&worker->readyMutex));
+}
+
+void MapReduceJob::startThread(void *arg) {
+  WorkerContext *worker = static_cast<WorkerContext *>(arg);
   // run
-  job->run(tid);
-  return nullptr;
+  worker->job->run(worker->tid);
 }
 
 void MapReduceJob::join() {
-  if (joined.load()) {
+  if (joined.exchange(true)) {
     return;
-  } 
-  
-  joined.store(true);
-  for (pthread_t &thread : threadpool) {
-    SAFE(pthread_join(thread, nullptr));
   }
+  // workers go back to the pool, wait for each of them to be done
+  long long start = now(CLOCK_MONOTONIC);
+  for (int i = 0; i < numThreads; i++) {
+    SAFE(sem_wait(&doneSem));
+  }
+  joinWaitTime = now(CLOCK_MONOTONIC) - start;
+  if (!traceFile.empty()) {
+    writeTrace();
+  }
+}
+
+void MapReduceJob::notifyDone() {
+  SAFE(pthread_mutex_lock(&notifyMutex));
+  done = true;
+  if (doneFd != -1) {
+    uint64_t one = 1;
+    SAFE(write(doneFd, &one, sizeof(one)) != sizeof(one));
+  }
+  SAFE(pthread_mutex_unlock(&notifyMutex));
+  if (onDone != nullptr) {
+    onDone(static_cast<JobHandle>(this), onDoneArg);
+  }
+}
+
+int MapReduceJob::getFd() {
+  SAFE(pthread_mutex_lock(&notifyMutex));
+  if (doneFd == -1) {
+    // readable right away when the job is done already
+    doneFd = eventfd(done ? 1 : 0, EFD_CLOEXEC);
+    SAFE(doneFd == -1);
+  }
+  SAFE(pthread_mutex_unlock(&notifyMutex));
+  return doneFd;
+}
+
+void MapReduceJob::follow(MapReduceJob *upstream, Pipe *pipe) {
+  upstream->sink = pipe;
+  this->upstream = upstream;
+  this->pipe = pipe;
 }
 
 stage_t MapReduceJob::getStage() { return stage; }
 
+void MapReduceJob::resetProgress() {
+  progress.store(0);
+  for (WorkerContext &worker : workers) {
+    worker.finishedItems.store(0);
+  }
+}
+
 float MapReduceJob::getStatePercentage() {
-  int count = counter.load();
-  int size = ((stage == MAP_STAGE)
-                  ? inputSize
-                  : ((stage == SHUFFLE_STAGE) ? intermediateSize : outputSize))
-                 .load();
+  size_t count = progress.load();
+  for (const WorkerContext &worker : workers) {
+    count += worker.finishedItems.load(std::memory_order_relaxed);
+  }
+  // a spilled job reduces while merging, its progress is counted in pairs
+  size_t size = (stage == MAP_STAGE) ? inputSize.load()
+                : (stage == SHUFFLE_STAGE || spilled) ? intermediateSize.load()
+                                                      : outputSize.load();
+  // nothing to count, or a source of unknown size
+  if (size == 0) {
+    return 0;
+  }
   return ((float)std::min(count, size)) / size * 100;
 }
+
+void MapReduceJob::getMetrics(JobMetrics *metrics) {
+  const double second = 1e9;
+  metrics->workers.resize(numThreads);
+  metrics->joinWaitTime = joinWaitTime.load() / second;
+  for (int i = 0; i < GROUP_SIZE_BUCKETS; i++) {
+    metrics->groupSizes[i] = 0;
+  }
+  metrics->largestGroup = 0;
+  for (int tid = 0; tid < numThreads; tid++) {
+    const WorkerCounters &counters = workers[tid].counters;
+    WorkerMetrics &worker = metrics->workers[tid];
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+      worker.wallTime[phase] = counters.wallTime[phase].load() / second;
+      worker.cpuTime[phase] = counters.cpuTime[phase].load() / second;
+    }
+    worker.barrierWaitTime = counters.barrierWaitTime.load() / second;
+    worker.lockWaitTime = counters.lockWaitTime.load() / second;
+    worker.inputPairs = counters.inputPairs.load();
+    worker.intermediatePairs = counters.intermediatePairs.load();
+    worker.groups = counters.groups.load();
+    worker.outputPairs = counters.outputPairs.load();
+    worker.cachedInputs = counters.cachedInputs.load();
+    for (int i = 0; i < GROUP_SIZE_BUCKETS; i++) {
+      metrics->groupSizes[i] += counters.groupSizes[i].load();
+    }
+    metrics->largestGroup =
+        std::max(metrics->largestGroup, counters.largestGroup.load());
+  }
+}
@@ -1,52 +1,274 @@
+#include "Affinity.h"
+#include "Arena.h"
 #include "Barrier.h"
+#include "GroupTable.h"
+#include "LoserTree.h"
+#include "MapCache.h"
 #include "MapReduceFramework.h"
+#include "Pipe.h"
+#include "RadixSort.h"
+#include "SpillRun.h"
+#include "WorkerPool.h"
 #include <atomic>
 #include <map>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sstream>
+#include <string>
 #include <vector>
 
+// size of a cache line, the alignment of per-thread state
+#define CACHE_LINE_SIZE 64
+
+class MapReduceJob;
+
+// a span of a worker's time in the trace of a job, in nanoseconds
+struct TraceEvent {
+  const char *name;
+  long long begin;
+  long long end;
+  // number of items handled in the span, 0 for none
+  size_t items;
+};
+
+// metrics of a worker, written by the worker alone and read while the job
+// runs. times are in nanoseconds
+struct WorkerCounters {
+  std::atomic<long long> wallTime[NUM_PHASES];
+  std::atomic<long long> cpuTime[NUM_PHASES];
+  std::atomic<long long> barrierWaitTime;
+  std::atomic<long long> lockWaitTime;
+  std::atomic<size_t> inputPairs;
+  std::atomic<size_t> intermediatePairs;
+  std::atomic<size_t> groups;
+  std::atomic<size_t> outputPairs;
+  std::atomic<size_t> cachedInputs;
+  std::atomic<size_t> groupSizes[GROUP_SIZE_BUCKETS];
+  std::atomic<size_t> largestGroup;
+
+  WorkerCounters();
+};
+
+// per-thread state of a job, passed to the client as the context of map and
+// reduce. emits only touch the worker's own cache lines
+struct alignas(CACHE_LINE_SIZE) WorkerContext {
+  MapReduceJob *job;
+  // index of the thread in the job
+  int tid;
+  // intermediate pairs emitted by this thread, sorted into a run after map
+  IntermediateVec intermediateVec;
+  // sorted runs spilled to disk by this thread, and the number of pairs in them
+  std::vector<SpillRun *> spillRuns;
+  size_t spilledPairs;
+  // number of pairs in intermediateVec that makes this thread spill during
+  // map. 0 when not spilling
+  size_t spillLimit;
+  // slot of each pair of intermediateVec in the group table, when hashing
+  std::vector<size_t> pairSlots;
+  // when caching map output, whether the pairs emitted are of a mapped input,
+  // and the pairs emitted for it so far, serialized
+  bool caching;
+  std::ostringstream cachePairs;
+  size_t numCachePairs;
+  // fingerprints of the inputs of this thread found in the map cache, and
+  // of the inputs it mapped with their entries, applied to the cache after
+  // the map phase
+  std::vector<uint64_t> cacheHits;
+  std::vector<std::pair<uint64_t, MapCache::Entry>> cacheMisses;
+  // maps of an asynchronous client started by this thread and not done yet,
+  // and the ones woken to be resumed, guarded by readyMutex. readyCv is
+  // signaled when a map is woken
+  size_t inFlight;
+  pthread_mutex_t readyMutex;
+  pthread_cond_t readyCv;
+  std::vector<void *> ready;
+  // output pairs emitted by this thread
+  OutputVec outputVec;
+  // items of the map or reduce stage this thread finished, counted one by
+  // one so progress doesn't wait for a whole chunk
+  std::atomic<size_t> finishedItems;
+  WorkerCounters counters;
+  // spans of this thread, when tracing
+  std::vector<TraceEvent> trace;
+  // memory for intermediate keys and values, freed with the job
+  Arena arena;
+};
+
 class MapReduceJob {
 private:
+  // k-way merge of the thread slices of a key range, from the largest key down
+  typedef LoserTree<IntermediateVec::reverse_iterator,
+                    bool (*)(const IntermediatePair &, const IntermediatePair &)>
+      SliceMerge;
+
+  // ascending order of pairs by key
+  struct PairLess {
+    bool operator()(const IntermediatePair &p1,
+                    const IntermediatePair &p2) const {
+      return *p1.first < *p2.first;
+    }
+  };
+  // k-way merge of the memory and spilled runs of a key range
+  typedef LoserTree<RunCursor, PairLess> RunMerge;
+
   const MapReduceClient &client;
   const InputVec &inputVec;
+  // input pulled in batches instead of inputVec, null for inputVec
+  InputSource *source;
+  // serializes calls to source, and whether it is exhausted
+  pthread_mutex_t sourceMutex;
+  bool sourceDone;
   OutputVec &outputVec;
+  // in a pipeline, the pipe the output goes to instead of outputVec, and the
+  // stage before this one with the pipe between them, owned by the job.
+  // null when there is none
+  Pipe *sink;
+  MapReduceJob *upstream;
+  Pipe *pipe;
+  // directory for spilled runs
+  std::string spillDirectory;
+  // map output cached by the last run, null when not caching
+  MapCache *mapCache;
+  // whether the client maps asynchronously, and the most maps a thread
+  // keeps suspended
+  bool mapsAsync;
+  size_t mapsInFlight;
+  // CPU of each thread, empty when threads aren't pinned
+  std::vector<int> affinity;
   // number of threads
   int numThreads;
-  // threads
-  std::vector<pthread_t> threadpool;
-  // intermediate vectors creates, in the map phase and rearranged in the
-  // shuffle phase
-  std::vector<IntermediateVec> intermediateVectors;
+  // per-thread state, workers[tid] is the context of thread tid
+  std::vector<WorkerContext> workers;
+  // keys splitting the shuffle into one key range per thread. chosen by
+  // sampling the sorted runs, range tid is [splitters[tid - 1], splitters[tid])
+  std::vector<K2 *> splitters;
+  // splitters copied from memory runs when spilling, owned by the job since
+  // their originals are deleted by reduce while other ranges still use them
+  std::vector<K2 *> splitterCopies;
+  // whether any thread spilled. only modified by thread 0
+  std::atomic<bool> spilled;
+  // whether pairs are grouped by hash instead of sorted
+  bool hashing;
+  // table of the distinct keys when hashing, built in the shuffle phase
+  GroupTable *table;
+  // whether a thread found no room for a key in the table
+  std::atomic<bool> tableFull;
+  // reduce groups built by each thread from its key range in the shuffle
+  // phase, as views of the spans in groupSpans[tid]. the spans are in the
+  // sorted runs, moved to runs after the shuffle, or in hashedGroups when
+  // hashing
+  std::vector<std::vector<GroupView>> groups;
+  std::vector<std::vector<PairSpan>> groupSpans;
+  std::vector<IntermediateVec> runs;
+  std::vector<std::vector<IntermediateVec>> hashedGroups;
+  // groupOffsets[k] is the global index of the first group of the k-th
+  // highest key range
+  std::vector<int> groupOffsets;
+  // indexes of the groups in the order they are reduced, largest first, and
+  // scheduleOffsets[i] the number of pairs in the groups before schedule[i]
+  std::vector<int> schedule;
+  std::vector<size_t> scheduleOffsets;
+  // a part of an oversized group, combined on its own when the client is
+  // associative. result holds the pairs combine emitted for it
+  struct GroupPart {
+    int group;
+    size_t begin;
+    size_t end;
+    IntermediateVec result;
+  };
+  std::vector<GroupPart> parts;
+  // spans of the combined parts, the split groups are views of them
+  std::vector<PairSpan> partSpans;
+  // outputOffsets[tid] is the index in outputVec of the output of thread tid
+  std::vector<size_t> outputOffsets;
 
   /********** Pool-level methods and synchronization ********/
 
   // stage of the job. only modified by thread 0
-  stage_t stage;
+  std::atomic<stage_t> stage;
   // atomic flag for indicating if job is joined
   std::atomic<bool> joined;
-  // atomic counter for creating thread IDs
-  std::atomic<int> nextTid;
-  // atomic counter for tracking stage progress
-  std::atomic<int> counter;
+  // atomic counter for claiming items of the map and reduce phases
+  std::atomic<size_t> counter;
+  // atomic counter for tracking stage progress, counts finished items
+  std::atomic<size_t> progress;
   // atomic counters for tacking number of pairs
-  std::atomic<int> inputSize, intermediateSize, outputSize;
-  // barrier for sort phase
+  std::atomic<size_t> inputSize, outputSize, intermediateSize;
+  // barrier between phases
   Barrier barrier;
-  // semaphore for shuffle phase
-  sem_t shuffleSem;
-  // mutex for outputVec
-  pthread_mutex_t outputVecMutex;
-
-  // find the key with the maximum value across all intermediate vectors.
-  // assumes vecs are sorted
-  K2 *findMaxKey();
-  // shuffle intermediate vectors from threads to this->intermediateVectors
-  void shuffle();
-  // get currently running tid (index in pool)
-  int currentTid();
-  // static wrapper for run
-  static void *startThread(void *arg);
+  // posted by each thread when it is done with the job
+  sem_t doneSem;
+  // number of threads done with the job
+  std::atomic<int> finished;
+  // completion notifications: the eventfd, created on demand (-1 before),
+  // and the callback. notifyMutex orders creating the eventfd and done
+  pthread_mutex_t notifyMutex;
+  int doneFd;
+  bool done;
+  void (*onDone)(JobHandle job, void *arg);
+  void *onDoneArg;
+  // notify that the job is done. called by the last thread
+  void notifyDone();
+  // time join waited for doneSem, in nanoseconds
+  std::atomic<long long> joinWaitTime;
+  // trace file of the job, empty for no tracing, and the time the job
+  // started
+  std::string traceFile;
+  long long startTime;
+
+  // record a span of tid that started at begin and ends now, when tracing
+  void trace(int tid, const char *name, long long begin, size_t items = 0);
+  // the current time for a span, when tracing
+  long long traceTime();
+  // write the spans of all threads as a Chrome trace
+  void writeTrace();
+
+  // wait at the barrier, counting the wait in the metrics of tid
+  void waitBarrier(int tid);
+  // lock the input source, counting the wait in the metrics of tid
+  void lockSource(int tid);
+  // start counting the progress of a stage from 0
+  void resetProgress();
+  // count a reduced group in the metrics of tid
+  void countGroup(int tid, size_t size);
+  // map an input pair, or replay its pairs from the map cache. the pair
+  // counts as finished once its map is done, not while it's suspended
+  void mapPair(int tid, const InputPair &pair);
+  // apply the cache hits and misses of all threads to the map cache
+  void updateCache();
+  // resume the woken maps of tid, waiting for more while over limit maps
+  // are suspended
+  void resumeMaps(int tid, size_t limit);
+
+  // pull the next batch of the input source, returns false when it's
+  // exhausted
+  bool nextBatch(int tid, InputVec &batch);
+  // claim the next chunk [begin, end) of a phase with size items from
+  // counter. returns false when all items are claimed
+  bool claimChunk(size_t size, size_t &begin, size_t &end);
+  // claim the next chunk [begin, end) of the schedule, sized by the number
+  // of pairs it holds instead of the number of groups
+  bool claimGroups(size_t &begin, size_t &end);
+  // split groups much larger than the rest into parts, when the client is
+  // associative
+  void splitGroups();
+  // order the groups for reduce, largest first
+  void scheduleGroups();
+  // choose splitters by sampling the sorted intermediate vectors and the
+  // indexes of spilled runs
+  void sampleSplitters();
+  // estimate the number of distinct keys from a sample of the pairs, when
+  // hashing
+  size_t estimateKeys();
+  // copy a key through the client's serialization
+  K2 *copyKey(const IntermediatePair &pair);
+  // view the groups of the spans of tid, spanEnds[i] is the end of the spans
+  // of the i-th group
+  void viewGroups(int tid, const std::vector<size_t> &spanEnds);
+  // get the reduce group with the given global index
+  GroupView &getGroup(int index);
+  // static wrapper for run, the task given to the pool
+  static void startThread(void *arg);
 
   /********** Thread-level methods **************************/
 
@@ -56,21 +278,57 @@ private:
   void map(int tid);
   // sort phase
   void sort(int tid);
+  // sort the thread's intermediate vector, and combine if the client does
+  void sortRun(int tid);
+  // sort the thread's intermediate vector by normalized key
+  void radixSortRun(int tid);
+  // fold same-key pairs of the sorted run with the client's combiner
+  void combine(int tid);
+  // write the thread's intermediate vector to disk as a sorted run
+  void spill(int tid);
+  // merge the thread's width smallest spilled runs into one
+  void mergeRuns(int tid, size_t width);
+  // merge the spilled runs of all threads down to as many as every reduce
+  // thread can read at once
+  void mergeSpilledRuns(int tid);
   // shuffle phase
   void shuffle(int tid);
+  // group the pairs by key in the group table, each group goes to the
+  // thread whose share of the table has its slot
+  void hashGroups(int tid);
+  // merge the memory and spilled runs of the thread's key range from disk
+  // and reduce each group as it is merged
+  void streamRange(int tid);
+  // combine the parts of split groups and put the results back in their
+  // groups
+  void combineParts(int tid);
   // reduce phase
   void reduce(int tid);
 
 public:
-  MapReduceJob(const MapReduceClient &client, const InputVec &inputVec,
-               OutputVec &outputVec, int numThreads);
+  MapReduceJob(WorkerPool &pool, const MapReduceClient &client,
+               const InputVec &inputVec, InputSource *source,
+               OutputVec &outputVec, int numThreads, const JobConfig &config,
+               std::vector<WorkerPool::Task> *gang = nullptr);
   ~MapReduceJob();
 
-  void insert2(K2 *key, V2 *value);
-  void insert3(K3 *key, V3 *value);
+  // make this job the stage after upstream in a pipeline, mapping the pipe
+  // upstream reduces to (also the source of this job). the job owns both.
+  // called before the jobs run
+  void follow(MapReduceJob *upstream, Pipe *pipe);
+
+  void insert2(WorkerContext *worker, K2 *key, V2 *value);
+  void insert3(WorkerContext *worker, K3 *key, V3 *value);
+  // insert count pairs at once
+  void insert2(WorkerContext *worker, const IntermediatePair *pairs,
+               size_t count);
+  void insert3(WorkerContext *worker, const OutputPair *pairs, size_t count);
+  void wake(WorkerContext *worker, void *item);
 
   void join();
+  int getFd();
 
   stage_t getStage();
   float getStatePercentage();
+  void getMetrics(JobMetrics *metrics);
 };
\ No newline at end of file
@@ -0,0 +1,275 @@
+#ifndef MAPREDUCETYPED_H
+#define MAPREDUCETYPED_H
+
+#include "LoserTree.h"
+#include "MapReduceFramework.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// a header-only MapReduce front end for clients with concrete key and value
+// types. pairs are stored by value in contiguous per-thread vectors and keys
+// are compared with their own operator<, so sort and shuffle have no virtual
+// calls or per-pair allocations.
+//
+// a client declares its types and the map and reduce functions:
+//
+//   struct Client {
+//     typedef ... K1, V1, K2, V2, K3, V3;
+//     void map(const K1 &key, const V1 &value,
+//              typed::Emitter<K2, V2> &emit) const;
+//     void reduce(const K2 &key, const std::pair<K2, V2> *begin,
+//                 const std::pair<K2, V2> *end,
+//                 typed::Emitter<K3, V3> &emit) const;
+//   };
+//
+// reduce gets the pairs of a single key as a contiguous range.
+
+namespace typed {
+
+// collects the pairs emitted by map or reduce into a thread's vector
+template <class K, class V> class Emitter {
+public:
+  explicit Emitter(std::vector<std::pair<K, V>> &pairs) : pairs(pairs) {}
+  void operator()(K key, V value) {
+    pairs.emplace_back(std::move(key), std::move(value));
+  }
+
+private:
+  std::vector<std::pair<K, V>> &pairs;
+};
+
+// a multiple use barrier, like Barrier.h without the library
+class ThreadBarrier {
+public:
+  explicit ThreadBarrier(int numThreads)
+      : count(0), generation(0), numThreads(numThreads) {}
+  void barrier() {
+    std::unique_lock<std::mutex> lock(mutex);
+    int current = generation;
+    if (++count < numThreads) {
+      cv.wait(lock, [this, current] { return generation != current; });
+    } else {
+      count = 0;
+      generation++;
+      cv.notify_all();
+    }
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable cv;
+  int count;
+  int generation;
+  int numThreads;
+};
+
+template <class Client> class MapReduceJob {
+public:
+  typedef typename Client::K1 K1;
+  typedef typename Client::V1 V1;
+  typedef typename Client::K2 K2;
+  typedef typename Client::V2 V2;
+  typedef typename Client::K3 K3;
+  typedef typename Client::V3 V3;
+  typedef std::vector<std::pair<K1, V1>> InputVec;
+  typedef std::vector<std::pair<K2, V2>> IntermediateVec;
+  typedef std::vector<std::pair<K3, V3>> OutputVec;
+
+  MapReduceJob(const Client &client, const InputVec &inputVec,
+               OutputVec &outputVec, int numThreads)
+      : client(client), inputVec(inputVec), outputVec(outputVec),
+        numThreads(numThreads), workers(numThreads), barrier(numThreads),
+        stage(MAP_STAGE), counter(0), intermediateSize(0), joined(false) {
+    for (int i = 0; i < numThreads; i++) {
+      threads.emplace_back(&MapReduceJob::run, this, i);
+    }
+  }
+
+  ~MapReduceJob() { wait(); }
+
+  MapReduceJob(const MapReduceJob &) = delete;
+  MapReduceJob &operator=(const MapReduceJob &) = delete;
+
+  // wait for the job to finish. outputVec is ready after this returns
+  void wait() {
+    if (joined) {
+      return;
+    }
+    joined = true;
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // map progress counts input pairs, shuffle and reduce count pairs
+  void getState(JobState *state) const {
+    state->stage = stage.load();
+    size_t size = (state->stage == MAP_STAGE) ? inputVec.size()
+                                              : intermediateSize.load();
+    size_t count = std::min(counter.load(), size);
+    state->percentage = (size == 0) ? 100 : (float)count / size * 100;
+  }
+
+private:
+  struct Less {
+    bool operator()(const std::pair<K2, V2> &p1,
+                    const std::pair<K2, V2> &p2) const {
+      return p1.first < p2.first;
+    }
+  };
+  typedef LoserTree<typename IntermediateVec::iterator, Less> SliceMerge;
+
+  // per-thread state. the padding keeps the vectors of different threads
+  // off the same cache line, whatever the alignment of the array
+  struct Worker {
+    // emitted by map and sorted, then the merged pairs of the key range
+    IntermediateVec pairs;
+    OutputVec output;
+    char padding[64];
+  };
+
+  const Client &client;
+  const InputVec &inputVec;
+  OutputVec &outputVec;
+  int numThreads;
+  std::vector<Worker> workers;
+  std::vector<std::thread> threads;
+  // range tid of the shuffle is [splitters[tid - 1], splitters[tid])
+  std::vector<K2> splitters;
+  ThreadBarrier barrier;
+  // stage of the job. only modified by thread 0
+  std::atomic<stage_t> stage;
+  // claims input pairs in the map stage, counts pairs after it
+  std::atomic<size_t> counter;
+  std::atomic<size_t> intermediateSize;
+  bool joined;
+
+  void run(int tid) {
+    Worker &worker = workers[tid];
+
+    // map phase
+    Emitter<K2, V2> emit2(worker.pairs);
+    size_t index;
+    while ((index = counter.fetch_add(1)) < inputVec.size()) {
+      client.map(inputVec[index].first, inputVec[index].second, emit2);
+    }
+
+    // sort phase
+    std::sort(worker.pairs.begin(), worker.pairs.end(), Less());
+    intermediateSize.fetch_add(worker.pairs.size());
+    barrier.barrier();
+
+    // shuffle phase, each thread merges its own key range
+    if (tid == 0) {
+      stage = SHUFFLE_STAGE;
+      counter = 0;
+      sampleSplitters();
+    }
+    barrier.barrier();
+    // all slices are found before any thread moves pairs out of the runs
+    std::vector<typename SliceMerge::Run> slices = findSlices(tid);
+    barrier.barrier();
+    IntermediateVec range = merge(slices);
+    barrier.barrier();
+    worker.pairs = std::move(range);
+    if (tid == 0) {
+      stage = REDUCE_STAGE;
+      counter = 0;
+    }
+    barrier.barrier();
+
+    // reduce phase, each thread reduces the groups of its key range
+    Emitter<K3, V3> emit3(worker.output);
+    const std::pair<K2, V2> *pairs = worker.pairs.data();
+    size_t size = worker.pairs.size();
+    size_t begin = 0;
+    while (begin < size) {
+      size_t end = begin + 1;
+      while (end < size && !(pairs[begin].first < pairs[end].first)) {
+        end++;
+      }
+      client.reduce(pairs[begin].first, pairs + begin, pairs + end, emit3);
+      counter.fetch_add(end - begin);
+      begin = end;
+    }
+    barrier.barrier();
+
+    // output ordered by key range
+    if (tid == 0) {
+      for (Worker &w : workers) {
+        std::move(w.output.begin(), w.output.end(),
+                  std::back_inserter(outputVec));
+        OutputVec().swap(w.output);
+      }
+    }
+  }
+
+  // choose splitters by sampling the sorted runs evenly
+  void sampleSplitters() {
+    size_t stride = std::max<size_t>(
+        1, intermediateSize.load() / (numThreads * SAMPLES_PER_RANGE));
+    std::vector<K2> samples;
+    for (const Worker &worker : workers) {
+      for (size_t i = 0; i < worker.pairs.size(); i += stride) {
+        samples.push_back(worker.pairs[i].first);
+      }
+    }
+    std::sort(samples.begin(), samples.end());
+    splitters.clear();
+    for (int i = 1; i < numThreads && !samples.empty(); i++) {
+      splitters.push_back(samples[i * samples.size() / numThreads]);
+    }
+  }
+
+  // find the slice of each sorted run in the key range of tid
+  std::vector<typename SliceMerge::Run> findSlices(int tid) {
+    auto keyLess = [](const std::pair<K2, V2> &p, const K2 &key) {
+      return p.first < key;
+    };
+    std::vector<typename SliceMerge::Run> slices;
+    // with no splitters all pairs are in range 0
+    if (splitters.empty() && tid != 0) {
+      return slices;
+    }
+    bool first = (tid == 0);
+    bool last = (tid == numThreads - 1) || splitters.empty();
+    for (Worker &worker : workers) {
+      IntermediateVec &vec = worker.pairs;
+      auto lo = first ? vec.begin()
+                      : std::lower_bound(vec.begin(), vec.end(),
+                                         splitters[tid - 1], keyLess);
+      auto hi = last ? vec.end()
+                     : std::lower_bound(lo, vec.end(), splitters[tid], keyLess);
+      slices.push_back({lo, hi});
+    }
+    return slices;
+  }
+
+  // merge the slices of a key range into one sorted vector
+  IntermediateVec merge(const std::vector<typename SliceMerge::Run> &slices) {
+    size_t total = 0;
+    for (const typename SliceMerge::Run &slice : slices) {
+      total += slice.second - slice.first;
+    }
+    IntermediateVec range;
+    range.reserve(total);
+    SliceMerge merge(slices, Less());
+    while (!merge.empty()) {
+      merge.popEqual(range);
+    }
+    counter.fetch_add(total);
+    return range;
+  }
+
+  static const int SAMPLES_PER_RANGE = 8;
+};
+
+} // namespace typed
+
+#endif // MAPREDUCETYPED_H
@@ -0,0 +1,78 @@
+#include "MappedText.h"
+#include "Safe.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool TextView::operator<(const TextView &other) const {
+  int cmp = memcmp(data, other.data, std::min(size, other.size));
+  return cmp < 0 || (cmp == 0 && size < other.size);
+}
+
+bool TextView::operator==(const TextView &other) const {
+  return size == other.size && memcmp(data, other.data, size) == 0;
+}
+
+bool TextChunk::nextRecord(size_t &pos, TextView &record) const {
+  if (pos >= text.size) {
+    return false;
+  }
+  const char *begin = text.data + pos;
+  const char *end = static_cast<const char *>(
+      memchr(begin, delimiter, text.size - pos));
+  if (end == nullptr) {
+    // the last record of a file may have no delimiter
+    end = text.data + text.size;
+  }
+  record = {begin, (size_t)(end - begin)};
+  pos = end - text.data + 1;
+  return true;
+}
+
+MappedText::MappedText(const std::string &path, size_t chunkSize,
+                       char delimiter)
+    : data(nullptr), fileSize(0), nextChunk(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  CHECK(fd != -1, "open " + path);
+  struct stat st;
+  CHECK(fstat(fd, &st) == 0, "fstat " + path);
+  fileSize = st.st_size;
+  // an empty file can't be mapped, and has no chunks
+  if (fileSize != 0) {
+    void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    CHECK(mapping != MAP_FAILED, "mmap " + path);
+    data = static_cast<const char *>(mapping);
+  }
+  close(fd);
+
+  // cut after the first delimiter past each chunkSize bytes
+  chunkSize = std::max<size_t>(1, chunkSize);
+  size_t begin = 0;
+  while (begin < fileSize) {
+    size_t end = std::min(fileSize, begin + chunkSize);
+    const char *delim = static_cast<const char *>(
+        memchr(data + end - 1, delimiter, fileSize - end + 1));
+    end = (delim == nullptr) ? fileSize : delim - data + 1;
+    chunks.emplace_back(TextView{data + begin, end - begin}, begin, delimiter);
+    begin = end;
+  }
+}
+
+MappedText::~MappedText() {
+  if (data != nullptr) {
+    munmap(const_cast<char *>(data), fileSize);
+  }
+}
+
+size_t MappedText::next(InputVec &batch, size_t max) {
+  size_t count = std::min(max, chunks.size() - nextChunk);
+  for (size_t i = 0; i < count; i++, nextChunk++) {
+    batch.push_back({&chunks[nextChunk], &chunks[nextChunk]});
+  }
+  return count;
+}
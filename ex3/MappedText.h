@@ -0,0 +1,61 @@
+#ifndef MAPPEDTEXT_H
+#define MAPPEDTEXT_H
+#include "MapReduceFramework.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// a non-owning view of text in a mapped file, valid while the file is mapped
+struct TextView {
+  const char *data;
+  size_t size;
+
+  std::string str() const { return std::string(data, size); }
+  bool operator<(const TextView &other) const;
+  bool operator==(const TextView &other) const;
+};
+
+// a chunk of a mapped file, both the key and the value of an input pair.
+// chunks end on a record boundary, and are ordered by their offset
+class TextChunk : public K1, public V1 {
+public:
+  TextView text;
+  // offset of the chunk in the file
+  size_t offset;
+  // the record delimiter of the file
+  char delimiter;
+
+  TextChunk(TextView text, size_t offset, char delimiter)
+      : text(text), offset(offset), delimiter(delimiter) {}
+  bool operator<(const K1 &other) const {
+    return offset < static_cast<const TextChunk &>(other).offset;
+  }
+  // walk the records of the chunk, without their delimiters. pos starts at
+  // 0, returns false after the last record
+  bool nextRecord(size_t &pos, TextView &record) const;
+};
+
+// an input source that maps a text file and splits it into chunks of about
+// chunkSize bytes, ending on record boundaries. mappers get views into the
+// mapping, so records are neither copied nor allocated. the file stays
+// mapped until the source is deleted
+class MappedText : public InputSource {
+private:
+  const char *data;
+  size_t fileSize;
+  std::vector<TextChunk> chunks;
+  // index of the next chunk to hand out
+  size_t nextChunk;
+
+public:
+  MappedText(const std::string &path, size_t chunkSize = 1 << 20,
+             char delimiter = '\n');
+  ~MappedText();
+  MappedText(const MappedText &) = delete;
+  MappedText &operator=(const MappedText &) = delete;
+
+  size_t next(InputVec &batch, size_t max);
+  size_t size() const { return chunks.size(); }
+};
+
+#endif // MAPPEDTEXT_H
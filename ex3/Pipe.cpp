@@ -0,0 +1,78 @@
+#include "Pipe.h"
+#include "Safe.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+Pipe::Pipe(size_t capacity) : capacity(capacity), closed(false) {
+  SAFE(pthread_mutex_init(&mutex, nullptr));
+  SAFE(pthread_cond_init(&notEmpty, nullptr));
+  SAFE(pthread_cond_init(&notFull, nullptr));
+}
+
+Pipe::~Pipe() {
+  // pairs left by a reader that stopped early
+  release(InputVec(pairs.begin(), pairs.end()));
+  SAFE(pthread_cond_destroy(&notFull));
+  SAFE(pthread_cond_destroy(&notEmpty));
+  SAFE(pthread_mutex_destroy(&mutex));
+}
+
+void Pipe::push(OutputVec &output) {
+  // cast before locking, writers cast in parallel
+  InputVec batch;
+  batch.reserve(output.size());
+  for (const OutputPair &pair : output) {
+    K1 *key = dynamic_cast<K1 *>(pair.first);
+    V1 *value = dynamic_cast<V1 *>(pair.second);
+    if ((key == nullptr && pair.first != nullptr) ||
+        (value == nullptr && pair.second != nullptr)) {
+      std::cerr << "[[MapReduceFramework]] error on casting an output pair "
+                   "to an input pair of the next stage"
+                << std::endl;
+      exit(1);
+    }
+    batch.push_back(InputPair(key, value));
+  }
+  output.clear();
+
+  SAFE(pthread_mutex_lock(&mutex));
+  size_t begin = 0;
+  while (begin < batch.size()) {
+    while (pairs.size() >= capacity) {
+      SAFE(pthread_cond_wait(&notFull, &mutex));
+    }
+    size_t end = std::min(batch.size(), begin + capacity - pairs.size());
+    pairs.insert(pairs.end(), batch.begin() + begin, batch.begin() + end);
+    begin = end;
+    SAFE(pthread_cond_broadcast(&notEmpty));
+  }
+  SAFE(pthread_mutex_unlock(&mutex));
+}
+
+void Pipe::close() {
+  SAFE(pthread_mutex_lock(&mutex));
+  closed = true;
+  SAFE(pthread_cond_broadcast(&notEmpty));
+  SAFE(pthread_mutex_unlock(&mutex));
+}
+
+size_t Pipe::next(InputVec &batch, size_t max) {
+  SAFE(pthread_mutex_lock(&mutex));
+  while (pairs.empty() && !closed) {
+    SAFE(pthread_cond_wait(&notEmpty, &mutex));
+  }
+  size_t count = std::min(max, pairs.size());
+  batch.insert(batch.end(), pairs.begin(), pairs.begin() + count);
+  pairs.erase(pairs.begin(), pairs.begin() + count);
+  SAFE(pthread_cond_broadcast(&notFull));
+  SAFE(pthread_mutex_unlock(&mutex));
+  return count;
+}
+
+void Pipe::release(const InputVec &batch) {
+  for (const InputPair &pair : batch) {
+    delete pair.first;
+    delete pair.second;
+  }
+}
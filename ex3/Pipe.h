@@ -0,0 +1,49 @@
+#ifndef PIPE_H
+#define PIPE_H
+#include "MapReduceFramework.h"
+#include <cstddef>
+#include <deque>
+#include <pthread.h>
+
+// the stream of pairs between two stages of a pipeline: the output pairs
+// reduced by one job are the input pairs mapped by the next, as they are
+// emitted. a pair's objects must derive from K1 and K3 and from V1 and V3,
+// they are cast from one to the other and deleted once they are mapped.
+// writers block while the pipe is full and readers while it's empty, so at
+// most a few batches are in memory at a time.
+class Pipe : public InputSource {
+private:
+  pthread_mutex_t mutex;
+  // signaled when pairs are pushed or the pipe is closed, and when pairs are
+  // taken
+  pthread_cond_t notEmpty;
+  pthread_cond_t notFull;
+  std::deque<InputPair> pairs;
+  // most pairs the pipe holds before writers wait
+  size_t capacity;
+  // whether the writing stage is done
+  bool closed;
+
+public:
+  explicit Pipe(size_t capacity);
+  ~Pipe();
+  Pipe(const Pipe &) = delete;
+  Pipe &operator=(const Pipe &) = delete;
+
+  // output vector of the writing stage, whose output goes to the pipe
+  // instead, so it stays empty
+  OutputVec unused;
+
+  // move the output pairs to the pipe, waiting for room
+  void push(OutputVec &output);
+  // the writing stage is done, readers get the remaining pairs and then 0
+  void close();
+
+  // wait for pairs and take up to max of them, 0 once the pipe is closed and
+  // empty
+  size_t next(InputVec &batch, size_t max);
+  // delete the mapped pairs
+  void release(const InputVec &batch);
+};
+
+#endif // PIPE_H
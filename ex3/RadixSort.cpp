@@ -0,0 +1,35 @@
+#include "RadixSort.h"
+
+void radixSort(std::vector<RadixEntry> &entries,
+               std::vector<RadixEntry> &buffer) {
+  size_t size = entries.size();
+  if (size == 0) {
+    return;
+  }
+  buffer.resize(size);
+  // count the bytes of every pass in one read of the keys
+  std::vector<size_t> counts(8 * 256, 0);
+  for (const RadixEntry &entry : entries) {
+    for (int pass = 0; pass < 8; pass++) {
+      counts[pass * 256 + ((entry.key >> (8 * pass)) & 0xff)]++;
+    }
+  }
+  for (int pass = 0; pass < 8; pass++) {
+    size_t *count = &counts[pass * 256];
+    int shift = 8 * pass;
+    // all keys have the same byte, nothing moves
+    if (count[(entries[0].key >> shift) & 0xff] == size) {
+      continue;
+    }
+    size_t offsets[256];
+    size_t offset = 0;
+    for (int byte = 0; byte < 256; byte++) {
+      offsets[byte] = offset;
+      offset += count[byte];
+    }
+    for (const RadixEntry &entry : entries) {
+      buffer[offsets[(entry.key >> shift) & 0xff]++] = entry;
+    }
+    entries.swap(buffer);
+  }
+}
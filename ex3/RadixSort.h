@@ -0,0 +1,19 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// a normalized sort key and the index of the element it belongs to
+struct RadixEntry {
+  uint64_t key;
+  uint32_t index;
+};
+
+// sort entries by key with an LSD radix sort, a byte per pass. the sort is
+// stable, and passes over bytes that are the same in all keys are skipped.
+// buffer is scratch space, resized as needed
+void radixSort(std::vector<RadixEntry> &entries,
+               std::vector<RadixEntry> &buffer);
+
+#endif // RADIXSORT_H
@@ -0,0 +1,24 @@
+#ifndef SAFE_H
+#define SAFE_H
+
+#include <cstdlib>
+#include <iostream>
+
+// error handling of the library: an operation that fails prints what failed,
+// runs the given cleanup and exits
+
+#define CHECK_OR(x, what, cleanup)                                             \
+  if (!(x)) {                                                                  \
+    std::cerr << "[[MapReduceFramework]] error on " << what << std::endl;      \
+    cleanup;                                                                   \
+    exit(1);                                                                   \
+  }
+
+// check a condition, describing the failure with what
+#define CHECK(x, what) CHECK_OR(x, what, )
+
+// safe macro for error handling of system calls, which return 0 on success
+#define SAFE_OR(x, cleanup) CHECK_OR((x) == 0, #x, cleanup)
+#define SAFE(x) SAFE_OR(x, )
+
+#endif // SAFE_H
@@ -48,6 +48,20 @@ public:
     }
   }
 
+  virtual bool combines() const { return true; }
+
+  // sum the counts of a character within a thread, before the shuffle
+  virtual void combine(const IntermediateVec *pairs, void *context) const {
+    const char c = static_cast<const KChar *>(pairs->at(0).first)->c;
+    int count = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      count += static_cast<const VCount *>(pair.second)->count;
+      delete pair.first;
+      delete pair.second;
+    }
+    emit2(new KChar(c), new VCount(count), context);
+  }
+
   virtual void reduce(const IntermediateVec *pairs, void *context) const {
     const char c = static_cast<const KChar *>(pairs->at(0).first)->c;
     int count = 0;
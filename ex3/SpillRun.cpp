@@ -0,0 +1,179 @@
+#include "SpillRun.h"
+#include "LoserTree.h"
+#include "Safe.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+#include <unordered_set>
+
+// distance between indexed keys of a spilled run, in pairs
+#define SPILL_INDEX_STRIDE 256
+
+// files of the runs alive in the process, removed on an error
+static pthread_mutex_t runsMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_set<std::string> &runPaths() {
+  static std::unordered_set<std::string> paths;
+  return paths;
+}
+
+static void removeRuns() {
+  pthread_mutex_lock(&runsMutex);
+  for (const std::string &path : runPaths()) {
+    remove(path.c_str());
+  }
+  pthread_mutex_unlock(&runsMutex);
+}
+
+// error handling for file operations on spilled runs, which leaves no run
+// behind
+#define CHECK_RUN(x, what) CHECK_OR(x, what, removeRuns())
+
+// ascending order of pairs by key
+static bool pairLess(const IntermediatePair &p1, const IntermediatePair &p2) {
+  return *p1.first < *p2.first;
+}
+
+// k-way merge of whole spilled runs
+typedef LoserTree<RunCursor, bool (*)(const IntermediatePair &,
+                                      const IntermediatePair &)>
+    SpillMerge;
+
+SpillRun::SpillRun(const IntermediateVec &run, const std::string &dir)
+    : numPairs(0) {
+  std::ofstream out = create(dir);
+  for (const IntermediatePair &pair : run) {
+    append(out, pair);
+  }
+  CHECK_RUN(out.flush(), "write " + path);
+}
+
+SpillRun::SpillRun(const std::vector<SpillRun *> &runs,
+                   const MapReduceClient &client, const std::string &dir)
+    : numPairs(0) {
+  std::vector<SpillMerge::Run> cursors;
+  for (const SpillRun *run : runs) {
+    cursors.push_back({RunCursor(*run, client, nullptr, nullptr), RunCursor()});
+  }
+  std::ofstream out = create(dir);
+  SpillMerge merge(cursors, pairLess);
+  while (!merge.empty()) {
+    append(out, merge.pop());
+  }
+  CHECK_RUN(out.flush(), "write " + path);
+}
+
+std::ofstream SpillRun::create(const std::string &dir) {
+  // create a unique file
+  std::string name = dir + "/mapreduce-run-XXXXXX";
+  std::vector<char> buffer(name.begin(), name.end());
+  buffer.push_back('\0');
+  int fd = mkstemp(buffer.data());
+  CHECK_RUN(fd != -1, "mkstemp " + name);
+  close(fd);
+  path = buffer.data();
+  pthread_mutex_lock(&runsMutex);
+  runPaths().insert(path);
+  pthread_mutex_unlock(&runsMutex);
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  CHECK_RUN(out, "open " + path);
+  return out;
+}
+
+void SpillRun::append(std::ofstream &out, const IntermediatePair &pair) {
+  bool indexed = (numPairs % SPILL_INDEX_STRIDE == 0);
+  if (indexed) {
+    index.push_back({pair.first, numPairs, (std::streamoff)out.tellp()});
+  }
+  pair.first->serialize(out);
+  pair.second->serialize(out);
+  // indexed keys stay in memory, there's a copy on disk to read back
+  if (!indexed) {
+    delete pair.first;
+  }
+  delete pair.second;
+  numPairs++;
+}
+
+SpillRun::~SpillRun() {
+  for (IndexEntry &entry : index) {
+    delete entry.key;
+  }
+  pthread_mutex_lock(&runsMutex);
+  runPaths().erase(path);
+  pthread_mutex_unlock(&runsMutex);
+  remove(path.c_str());
+}
+
+RunCursor::RunCursor()
+    : next(nullptr), end(nullptr), client(nullptr), remaining(0),
+      hi(nullptr), done(true) {}
+
+RunCursor::RunCursor(const IntermediatePair *begin, const IntermediatePair *end)
+    : next(begin), end(end), client(nullptr), remaining(0), hi(nullptr),
+      done(false) {
+  ++*this;
+}
+
+RunCursor::RunCursor(const SpillRun &run, const MapReduceClient &client,
+                     K2 *lo, K2 *hi)
+    : next(nullptr), end(nullptr), client(&client),
+      in(new std::ifstream(run.getPath(), std::ios::binary)), hi(hi),
+      done(false) {
+  CHECK_RUN(*in, "open " + run.getPath());
+  // start at the last indexed key before lo, the pairs between it and lo
+  // are read and dropped
+  const std::vector<SpillRun::IndexEntry> &index = run.getIndex();
+  auto start = index.begin();
+  if (lo != nullptr && !index.empty()) {
+    start = std::lower_bound(index.begin(), index.end(), lo,
+                             [](const SpillRun::IndexEntry &entry, K2 *key) {
+                               return *entry.key < *key;
+                             });
+    if (start != index.begin()) {
+      --start;
+    }
+  }
+  if (start == index.end()) {
+    done = true;
+    return;
+  }
+  in->seekg(start->offset);
+  remaining = run.size() - start->pair;
+  read();
+  while (!done && lo != nullptr && *current.first < *lo) {
+    delete current.first;
+    delete current.second;
+    read();
+  }
+}
+
+RunCursor &RunCursor::operator++() {
+  if (client != nullptr) {
+    read();
+  } else if (next == end) {
+    done = true;
+  } else {
+    current = *next++;
+  }
+  return *this;
+}
+
+void RunCursor::read() {
+  if (remaining == 0) {
+    done = true;
+    return;
+  }
+  current = client->deserialize(*in);
+  CHECK_RUN(*in && current.first != nullptr, "reading a spilled run");
+  remaining--;
+  // the first pair after the range belongs to the next one
+  if (hi != nullptr && !(*current.first < *hi)) {
+    delete current.first;
+    delete current.second;
+    done = true;
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef SPILLRUN_H
+#define SPILLRUN_H
+#include "MapReduceClient.h"
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// a sorted run of intermediate pairs spilled to a file.
+// every SPILL_INDEX_STRIDE-th key stays in memory with its place in the file,
+// so a key range can be read without reading the file from its start.
+class SpillRun {
+public:
+  struct IndexEntry {
+    K2 *key;
+    // index of the pair in the run and its offset in the file
+    size_t pair;
+    std::streamoff offset;
+  };
+
+private:
+  std::string path;
+  size_t numPairs;
+  std::vector<IndexEntry> index;
+
+  // create the file in dir and open it for writing
+  std::ofstream create(const std::string &dir);
+  // write a pair at the end of the run, indexing its key or deleting it
+  void append(std::ofstream &out, const IntermediatePair &pair);
+
+public:
+  // write a sorted run to a new file in dir. the pairs are deleted, except
+  // the indexed keys which the run keeps until it is deleted
+  SpillRun(const IntermediateVec &run, const std::string &dir);
+  // merge spilled runs into a new file in dir, reading one pair of each
+  // run at a time. the runs are left for the caller to delete
+  SpillRun(const std::vector<SpillRun *> &runs, const MapReduceClient &client,
+           const std::string &dir);
+  // remove the file
+  ~SpillRun();
+  SpillRun(const SpillRun &) = delete;
+  SpillRun &operator=(const SpillRun &) = delete;
+
+  const std::string &getPath() const { return path; }
+  size_t size() const { return numPairs; }
+  // indexed keys in run order, the first entry is the first pair
+  const std::vector<IndexEntry> &getIndex() const { return index; }
+};
+
+// reads the pairs of a key range from a sorted run, in memory or spilled.
+// an input iterator for LoserTree, equal to another cursor only when both
+// are done. pairs read from a file are new and handed over to the reader.
+class RunCursor {
+public:
+  typedef std::input_iterator_tag iterator_category;
+  typedef IntermediatePair value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef IntermediatePair *pointer;
+  typedef IntermediatePair &reference;
+
+private:
+  // memory run position and end, null for a spilled run
+  const IntermediatePair *next;
+  const IntermediatePair *end;
+  // spilled run stream and the number of pairs left in the file
+  const MapReduceClient *client;
+  std::shared_ptr<std::ifstream> in;
+  size_t remaining;
+  // keys from hi on are out of range. null for no upper bound
+  K2 *hi;
+  IntermediatePair current;
+  bool done;
+
+  // read the next pair of the file into current
+  void read();
+
+public:
+  // a cursor that is done
+  RunCursor();
+  // the pairs of a memory run in [begin, end)
+  RunCursor(const IntermediatePair *begin, const IntermediatePair *end);
+  // the pairs of a spilled run with keys in [lo, hi), null for unbounded
+  RunCursor(const SpillRun &run, const MapReduceClient &client, K2 *lo,
+            K2 *hi);
+
+  IntermediatePair &operator*() { return current; }
+  RunCursor &operator++();
+  bool operator==(const RunCursor &other) const {
+    return done && other.done;
+  }
+  bool operator!=(const RunCursor &other) const { return !(*this == other); }
+};
+
+#endif // SPILLRUN_H
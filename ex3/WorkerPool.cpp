@@ -0,0 +1,148 @@
+#include "WorkerPool.h"
+#include "Safe.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// a gang leaves this part of a bounded pool's workers, at least one, to the
+// gangs submitted after it
+#define HEADROOM_PART 4
+
+WorkerPool::WorkerPool(int numThreads, int maxThreads)
+    : idle(0),
+      maxThreads(maxThreads == 0 ? 0 : std::max(maxThreads, numThreads)),
+      activeWeight(0), virtualTime(0), stopping(false) {
+  SAFE(pthread_mutex_init(&mutex, nullptr));
+  SAFE(pthread_cond_init(&cv, nullptr));
+  SAFE(pthread_mutex_lock(&mutex));
+  for (int i = 0; i < numThreads; i++) {
+    spawn();
+  }
+  SAFE(pthread_mutex_unlock(&mutex));
+}
+
+WorkerPool::~WorkerPool() {
+  SAFE(pthread_mutex_lock(&mutex));
+  stopping = true;
+  SAFE(pthread_cond_broadcast(&cv));
+  SAFE(pthread_mutex_unlock(&mutex));
+  for (pthread_t &thread : threads) {
+    SAFE(pthread_join(thread, nullptr));
+  }
+  SAFE(pthread_cond_destroy(&cv));
+  SAFE(pthread_mutex_destroy(&mutex));
+}
+
+void WorkerPool::submit(const std::vector<Task> &gang, int priority,
+                        double cost, double weight) {
+  SAFE(pthread_mutex_lock(&mutex));
+  // the gang finishes its share after cost more virtual time
+  waiting.push_back(new Gang{gang, priority, weight, virtualTime + cost,
+                             (int)gang.size()});
+  dispatch();
+  SAFE(pthread_mutex_unlock(&mutex));
+}
+
+int WorkerPool::clampThreads(int numThreads) const {
+  return (maxThreads == 0) ? numThreads : std::min(numThreads, maxThreads);
+}
+
+int WorkerPool::reserveThreads(int numThreads, double weight) {
+  SAFE(pthread_mutex_lock(&mutex));
+  int share = clampThreads(numThreads);
+  if (maxThreads != 0) {
+    // its weighted share, short of the headroom left to later gangs
+    int headroom = std::max(1, maxThreads / HEADROOM_PART);
+    share = std::min(share, maxThreads - headroom);
+    share = std::min(share, (int)std::ceil(maxThreads * weight /
+                                           (activeWeight + weight)));
+    // the workers not running or promised to waiting gangs, if any are left,
+    // so the gang starts at once instead of waiting for running ones
+    int free = maxThreads - ((int)threads.size() - idle);
+    for (const Gang *gang : waiting) {
+      free -= gang->tasks.size();
+    }
+    if (free > 0) {
+      share = std::min(share, free);
+    }
+    share = std::max(1, share);
+  }
+  activeWeight += weight;
+  SAFE(pthread_mutex_unlock(&mutex));
+  return share;
+}
+
+void WorkerPool::dispatch() {
+  while (!waiting.empty()) {
+    // highest priority, then earliest virtual finish, then earliest submitted
+    auto next = waiting.begin();
+    for (auto gang = waiting.begin() + 1; gang != waiting.end(); ++gang) {
+      if ((*gang)->priority > (*next)->priority ||
+          ((*gang)->priority == (*next)->priority &&
+           (*gang)->finish < (*next)->finish)) {
+        next = gang;
+      }
+    }
+    // reserve a worker for every task, so the whole gang runs at once
+    int size = (*next)->tasks.size();
+    while (idle < size &&
+           (maxThreads == 0 || (int)threads.size() < maxThreads)) {
+      spawn();
+    }
+    if (idle < size) {
+      // wait for running gangs to finish
+      return;
+    }
+    idle -= size;
+    virtualTime = std::max(virtualTime, (*next)->finish);
+    for (const Task &task : (*next)->tasks) {
+      tasks.push_back({task, *next});
+    }
+    waiting.erase(next);
+    SAFE(pthread_cond_broadcast(&cv));
+  }
+}
+
+WorkerPool &WorkerPool::defaultPool() {
+  static WorkerPool pool;
+  return pool;
+}
+
+void WorkerPool::spawn() {
+  pthread_t thread;
+  SAFE(pthread_create(&thread, nullptr, startWorker, this));
+  threads.push_back(thread);
+  idle++;
+}
+
+void *WorkerPool::startWorker(void *arg) {
+  static_cast<WorkerPool *>(arg)->work();
+  return nullptr;
+}
+
+void WorkerPool::work() {
+  SAFE(pthread_mutex_lock(&mutex));
+  while (true) {
+    // park until there is a task
+    while (tasks.empty() && !stopping) {
+      SAFE(pthread_cond_wait(&cv, &mutex));
+    }
+    if (tasks.empty()) {
+      break;
+    }
+    Queued queued = tasks.front();
+    tasks.pop_front();
+    SAFE(pthread_mutex_unlock(&mutex));
+    queued.task.run(queued.task.arg);
+    SAFE(pthread_mutex_lock(&mutex));
+    idle++;
+    // the gang leaves the pool with its last task
+    if (--queued.gang->unfinished == 0) {
+      activeWeight -= queued.gang->weight;
+      delete queued.gang;
+    }
+    dispatch();
+  }
+  SAFE(pthread_mutex_unlock(&mutex));
+}
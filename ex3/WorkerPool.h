@@ -0,0 +1,101 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+// a pool of threads that stay alive between jobs, parked on a condition
+// variable while there is nothing to run.
+// tasks are submitted in gangs that run at the same time on distinct
+// workers, so tasks of a gang may wait for each other (e.g. at a barrier).
+// the pool grows when a gang needs more workers than are idle, up to its
+// bound if it has one. at the bound, gangs wait for workers to finish: the
+// waiting gang with the highest priority goes first, and gangs of equal
+// priority share the pool fairly by their cost (weighted fair queueing over
+// a virtual time). a gang is never passed by smaller ones, so none starves.
+// gangs don't shrink once started, so on a bounded pool a gang is sized when
+// it is reserved (see reserveThreads): to its weighted share of the bound
+// among the gangs on the pool, to the workers free at the time if there are
+// any, and never to the whole bound, so a gang submitted later doesn't wait
+// for a long one to finish.
+class WorkerPool {
+public:
+  // a function to run on a worker
+  struct Task {
+    void (*run)(void *arg);
+    void *arg;
+  };
+
+private:
+  // a gang waiting for workers or running
+  struct Gang {
+    std::vector<Task> tasks;
+    int priority;
+    double weight;
+    // virtual time at which the gang's turn comes among equal priorities
+    double finish;
+    // number of tasks of the gang not finished yet
+    int unfinished;
+  };
+  // a task to run and its gang
+  struct Queued {
+    Task task;
+    Gang *gang;
+  };
+
+  pthread_mutex_t mutex;
+  // signaled when tasks are queued or the pool stops
+  pthread_cond_t cv;
+  std::vector<pthread_t> threads;
+  std::deque<Queued> tasks;
+  // gangs waiting for workers, in submission order
+  std::vector<Gang *> waiting;
+  // number of workers that are neither running nor reserved for a task
+  int idle;
+  // most workers the pool may have, 0 for no bound
+  int maxThreads;
+  // total weight of the gangs waiting or running
+  double activeWeight;
+  // virtual time of fair queueing, the finish time of the last gang started
+  double virtualTime;
+  bool stopping;
+
+  // start a new worker. called with mutex locked
+  void spawn();
+  // static wrapper for work
+  static void *startWorker(void *arg);
+  // run queued tasks until the pool stops
+  void work();
+  // start waiting gangs while there are workers for them. called with mutex
+  // locked
+  void dispatch();
+
+public:
+  // start the pool with numThreads parked workers, growing up to
+  // maxThreads workers (0 for no bound)
+  explicit WorkerPool(int numThreads = 0, int maxThreads = 0);
+  // stop and join all workers. running tasks are finished first
+  ~WorkerPool();
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // run all tasks at once, each on its own worker, once the gang's turn
+  // comes. cost is the gang's work divided by its weight. the gang must be
+  // reserved with its weight, and may not be larger than the bound (see
+  // clampThreads)
+  void submit(const std::vector<Task> &gang, int priority = 0,
+              double cost = 1, double weight = 1);
+
+  // the number of workers a gang of numThreads tasks can have
+  int clampThreads(int numThreads) const;
+  // size a gang of numThreads tasks and a weight, counting its weight among
+  // the gangs on the pool from now on, so gangs reserved together share the
+  // bound. returns the number of tasks the gang gets, at least one. the gang
+  // must be submitted next
+  int reserveThreads(int numThreads, double weight);
+
+  // the pool used by jobs started without one
+  static WorkerPool &defaultPool();
+};
+
+#endif // WORKERPOOL_H
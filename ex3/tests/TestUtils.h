@@ -0,0 +1,116 @@
+#ifndef TESTUTILS_H
+#define TESTUTILS_H
+#include "../MapReduceClient.h"
+#include "../MapReduceFramework.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+
+// shared fixtures of the tests: a number usable as any key or value, a
+// client counting the pairs of each key, and helpers for their inputs and
+// outputs
+
+struct Number : public K1, public V1, public K2, public V2, public K3,
+                public V3 {
+  int n;
+  Number(int n) : n(n) {}
+  bool operator<(const K1 &other) const { return n < ((Number &)other).n; }
+  bool operator<(const K2 &other) const { return n < ((Number &)other).n; }
+  bool operator<(const K3 &other) const { return n < ((Number &)other).n; }
+  size_t hash() const { return n; }
+  bool equals(const K2 &other) const { return n == ((Number &)other).n; }
+  void serialize(std::ostream &out) const { out << n << ' '; }
+};
+
+// (n, -) -> (n, 1) -> (n, count), folding counts with an optional combiner.
+// its pairs can be spilled
+struct CountClient : public MapReduceClient {
+  bool combiner;
+  explicit CountClient(bool combiner = false) : combiner(combiner) {}
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Number(((Number *)key)->n), new Number(1), context);
+  }
+  bool combines() const { return combiner; }
+  void combine(const IntermediateVec *pairs, void *context) const {
+    int count = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      count += ((Number *)pair.second)->n;
+      delete pair.second;
+    }
+    for (size_t i = 1; i < pairs->size(); i++) {
+      delete pairs->at(i).first;
+    }
+    emit2(pairs->at(0).first, new Number(count), context);
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int n = ((Number *)pairs->at(0).first)->n;
+    int count = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      count += ((Number *)pair.second)->n;
+      delete pair.first;
+      delete pair.second;
+    }
+    emit3(new Number(n), new Number(count), context);
+  }
+  bool spills() const { return true; }
+  IntermediatePair deserialize(std::istream &in) const {
+    int key, value;
+    in >> key >> value;
+    return IntermediatePair(new Number(key), new Number(value));
+  }
+};
+
+// size numbers drawn from [0, range), after srand
+inline InputVec randomInput(int size, int range) {
+  InputVec input;
+  for (int i = 0; i < size; i++) {
+    input.push_back({new Number(rand() % range), nullptr});
+  }
+  return input;
+}
+
+// the numbers [0, size)
+inline InputVec sequenceInput(int size) {
+  InputVec input;
+  for (int i = 0; i < size; i++) {
+    input.push_back({new Number(i), nullptr});
+  }
+  return input;
+}
+
+inline void freeInput(InputVec &input) {
+  for (InputPair &pair : input) {
+    delete pair.first;
+  }
+  input.clear();
+}
+
+inline void freeOutput(OutputVec &output) {
+  for (OutputPair &pair : output) {
+    delete pair.first;
+    delete pair.second;
+  }
+  output.clear();
+}
+
+// check that the output has each key of the input once, with its number of
+// pairs in the input, and free it
+inline bool checkCounts(const InputVec &input, OutputVec &output) {
+  std::map<int, int> expected;
+  for (const InputPair &pair : input) {
+    expected[((Number *)pair.first)->n]++;
+  }
+  bool ok = output.size() == expected.size();
+  for (const OutputPair &pair : output) {
+    auto count = expected.find(((Number *)pair.first)->n);
+    ok = ok && count != expected.end() &&
+         count->second == ((Number *)pair.second)->n;
+    if (count != expected.end()) {
+      count->second = -1;
+    }
+  }
+  freeOutput(output);
+  return ok;
+}
+
+#endif // TESTUTILS_H
@@ -0,0 +1,124 @@
+/**
+ * Shuffle merge benchmark: the old max-key scan against the loser tree, over
+ * the sorted runs of 4, 16 and 64 threads.
+ */
+#include "../LoserTree.h"
+#include "../MapReduceClient.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define PAIRS 2000000
+#define ROUNDS 3
+
+static long comparisons = 0;
+
+struct Number : public K2, public V2 {
+  int n;
+  Number(int n) : n(n) {}
+  bool operator<(const K2 &other) const {
+    comparisons++;
+    return n < static_cast<const Number &>(other).n;
+  }
+};
+
+struct Descending {
+  bool operator()(const IntermediatePair &p1,
+                  const IntermediatePair &p2) const {
+    return *p2.first < *p1.first;
+  }
+};
+
+// the single-threaded shuffle this framework used before the loser tree
+static size_t scanShuffle(std::vector<IntermediateVec> runs) {
+  std::vector<IntermediateVec> result;
+  while (true) {
+    K2 *key = nullptr;
+    for (const IntermediateVec &vec : runs) {
+      if (!vec.empty() && (key == nullptr || *key < *vec.back().first)) {
+        key = vec.back().first;
+      }
+    }
+    if (key == nullptr) {
+      break;
+    }
+    IntermediateVec resultVec;
+    for (IntermediateVec &vec : runs) {
+      while (!(vec.empty() || *vec.back().first < *key ||
+               *key < *vec.back().first)) {
+        resultVec.push_back(vec.back());
+        vec.pop_back();
+      }
+    }
+    result.push_back(resultVec);
+  }
+  return result.size();
+}
+
+static size_t treeShuffle(std::vector<IntermediateVec> runs) {
+  typedef LoserTree<IntermediateVec::reverse_iterator, Descending> Merge;
+  std::vector<Merge::Run> slices;
+  for (IntermediateVec &vec : runs) {
+    slices.push_back({vec.rbegin(), vec.rend()});
+  }
+  Merge merge(slices, Descending());
+  std::vector<IntermediateVec> result;
+  while (!merge.empty()) {
+    IntermediateVec resultVec;
+    merge.popEqual(resultVec);
+    result.push_back(std::move(resultVec));
+  }
+  return result.size();
+}
+
+template <class Shuffle>
+static void measure(const char *name, int range, int threads, Shuffle shuffle,
+                    const std::vector<IntermediateVec> &runs) {
+  // best of a few rounds, the shuffle is short enough to be noisy
+  size_t groups = 0;
+  double ms = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    comparisons = 0;
+    auto start = std::chrono::steady_clock::now();
+    groups = shuffle(runs);
+    double elapsed = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    ms = (round == 0) ? elapsed : std::min(ms, elapsed);
+  }
+  printf("%-4s %7d keys %2d threads: %8zu groups %10ld comparisons %7.1f ms\n",
+         name, range, threads, groups, comparisons, ms);
+}
+
+int main() {
+  // hot keys repeat in every run, distinct keys mostly appear once
+  for (int range : {PAIRS / 20, PAIRS}) {
+    std::vector<Number *> numbers;
+    srand(0);
+    for (int i = 0; i < PAIRS; i++) {
+      numbers.push_back(new Number(rand() % range));
+    }
+
+    for (int threads : {4, 16, 64}) {
+      // deal the pairs to threads and sort each run, like the sort phase does
+      std::vector<IntermediateVec> runs(threads);
+      for (int i = 0; i < PAIRS; i++) {
+        runs[i % threads].push_back({numbers[i], numbers[i]});
+      }
+      for (IntermediateVec &vec : runs) {
+        std::sort(vec.begin(), vec.end(),
+                  [](const IntermediatePair &p1, const IntermediatePair &p2) {
+                    return *p1.first < *p2.first;
+                  });
+      }
+      measure("scan", range, threads, scanShuffle, runs);
+      measure("tree", range, threads, treeShuffle, runs);
+    }
+
+    for (Number *number : numbers) {
+      delete number;
+    }
+  }
+  return 0;
+}
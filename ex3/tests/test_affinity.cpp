@@ -0,0 +1,89 @@
+/**
+ * Affinity: jobs pinned compact, scattered or to a list of CPUs must give
+ * the right output with every map running on an allowed CPU, and on the
+ * listed CPU for a list. listed CPUs that can't be used are skipped, and
+ * a list of only those runs the job unpinned.
+ */
+#include "TestUtils.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <sched.h>
+
+#define N 10000
+#define RANGE 100
+#define THREADS 4
+
+static cpu_set_t allowed;
+
+struct PlacementClient : public CountClient {
+  // the CPU every map must run on, -1 for any allowed CPU
+  int cpu;
+  mutable std::atomic<int> misplaced;
+  explicit PlacementClient(int cpu) : cpu(cpu), misplaced(0) {}
+  void map(const K1 *key, const V1 *value, void *context) const {
+    int current = sched_getcpu();
+    if (!CPU_ISSET(current, &allowed) || (cpu != -1 && current != cpu)) {
+      misplaced++;
+    }
+    CountClient::map(key, value, context);
+  }
+};
+
+int main() {
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  int firstCpu = 0;
+  while (!CPU_ISSET(firstCpu, &allowed)) {
+    firstCpu++;
+  }
+
+  srand(0);
+  InputVec input = randomInput(N, RANGE);
+
+  // a listed CPU out of range or not allowed is skipped
+  int disallowed = firstCpu;
+  while (disallowed < CPU_SETSIZE && CPU_ISSET(disallowed, &allowed)) {
+    disallowed++;
+  }
+  int invalid[] = {-1, CPU_SETSIZE + 1, disallowed};
+  int mixed[] = {-1, CPU_SETSIZE + 1, disallowed, firstCpu};
+
+  struct Case {
+    affinity_t policy;
+    const int *cpus;
+    int numCpus;
+    // the CPU every map must run on, -1 for any allowed CPU
+    int cpu;
+  };
+  Case cases[] = {{COMPACT_AFFINITY, nullptr, 0, -1},
+                  {SCATTER_AFFINITY, nullptr, 0, -1},
+                  {LIST_AFFINITY, &firstCpu, 1, firstCpu},
+                  {LIST_AFFINITY, mixed, 4, firstCpu},
+                  {LIST_AFFINITY, invalid, 3, -1},
+                  {NO_AFFINITY, nullptr, 0, -1}};
+
+  PoolHandle pool = createWorkerPool(THREADS);
+  for (const Case &test : cases) {
+    affinity_t policy = test.policy;
+    PlacementClient client(test.cpu);
+    JobConfig config = JobConfig();
+    config.affinity = policy;
+    config.cpus = test.cpus;
+    config.numCpus = test.numCpus;
+    OutputVec output;
+    JobHandle job =
+        startMapReduceJob(pool, client, input, output, THREADS, config);
+    closeJobHandle(job);
+
+    if (!checkCounts(input, output) || client.misplaced != 0) {
+      std::cout << "ERROR: WRONG OUTPUT OR PLACEMENT WITH POLICY " << policy
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  closeWorkerPool(pool);
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
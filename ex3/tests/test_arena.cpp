@@ -0,0 +1,107 @@
+/**
+ * Arena allocation: a mapper constructing its pairs with new2 on several
+ * threads, and a reducer that never deletes them, must give the counts of
+ * the input. allocations from allocate2 must be aligned for any type, and
+ * allocations larger than a block must keep their contents until reduce.
+ */
+#include "TestUtils.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#define N 100000
+#define RANGE 1000
+#define THREADS 4
+// larger than an arena block
+#define LARGE (1 << 20)
+// inputs mapping to a large allocation
+#define LARGE_STRIDE 5000
+
+// a value holding a large buffer filled with one byte
+struct Blob : public V2 {
+  unsigned char *data;
+  unsigned char fill;
+  Blob(unsigned char *data, unsigned char fill) : data(data), fill(fill) {
+    memset(data, fill, LARGE);
+  }
+};
+
+static bool aligned(const void *p) {
+  return (uintptr_t)p % alignof(std::max_align_t) == 0;
+}
+
+struct ArenaClient : public MapReduceClient {
+  mutable std::atomic<int> misaligned, corrupt;
+  ArenaClient() : misaligned(0), corrupt(0) {}
+  // (n, -) -> (n % RANGE, 1), and (-1, blob) for every LARGE_STRIDE-th n
+  void map(const K1 *key, const V1 *value, void *context) const {
+    int n = ((Number *)key)->n;
+    // odd sizes must not throw off the alignment of what follows
+    for (size_t size : {1, 3, 17, 33}) {
+      misaligned += !aligned(allocate2(size, context));
+    }
+    Number *k2 = new2<Number>(context, n % RANGE);
+    Number *v2 = new2<Number>(context, 1);
+    misaligned += !aligned(k2) + !aligned(v2);
+    emit2(k2, v2, context);
+    if (n % LARGE_STRIDE == 0) {
+      unsigned char *data = (unsigned char *)allocate2(LARGE, context);
+      misaligned += !aligned(data);
+      emit2(new2<Number>(context, -1),
+            new2<Blob>(context, data, (unsigned char)(n / LARGE_STRIDE)),
+            context);
+    }
+  }
+  // the pairs are in the arenas, they are left for the job to free
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int n = ((Number *)pairs->at(0).first)->n;
+    if (n == -1) {
+      for (const IntermediatePair &pair : *pairs) {
+        const Blob *blob = (Blob *)pair.second;
+        for (int i = 0; i < LARGE; i++) {
+          corrupt += blob->data[i] != blob->fill;
+        }
+      }
+      emit3(new Number(n), new Number(pairs->size()), context);
+      return;
+    }
+    int count = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      count += ((Number *)pair.second)->n;
+    }
+    emit3(new Number(n), new Number(count), context);
+  }
+};
+
+int main() {
+  InputVec input;
+  for (int i = 0; i < N; i++) {
+    input.push_back({new Number(i), nullptr});
+  }
+
+  ArenaClient client;
+  OutputVec output;
+  JobHandle job = startMapReduceJob(client, input, output, THREADS);
+  closeJobHandle(job);
+
+  bool ok = output.size() == RANGE + 1;
+  for (OutputPair &pair : output) {
+    int n = ((Number *)pair.first)->n;
+    int count = ((Number *)pair.second)->n;
+    ok = ok && count == ((n == -1) ? N / LARGE_STRIDE : N / RANGE);
+    delete pair.first;
+    delete pair.second;
+  }
+  if (!ok || client.misaligned != 0 || client.corrupt != 0) {
+    std::cout << "ERROR: WRONG OUTPUT, MISALIGNED OR CORRUPT ALLOCATIONS"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * Asynchronous map: maps that each wait twice on a slow lookup service must
+ * overlap their waits, so a job takes a small part of the time of waiting
+ * for them one by one, and still emit all pairs. built as C++20, the same
+ * is checked for maps written as coroutines. suspended maps must not count
+ * toward the progress of the map stage until they're done.
+ */
+#include "../MapReduceAsync.h"
+#include "TestUtils.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#define N 1000
+#define RANGE 100
+#define THREADS 2
+#define LOOKUP_MS 10
+#define LOOKUPS_PER_MAP 2
+// maps held suspended by the progress check, all in flight at once
+#define HELD 100
+
+typedef std::chrono::steady_clock Clock;
+
+// a service answering each request LOOKUP_MS after it's sent, by waking the
+// map that sent it
+class LookupService {
+  struct Request {
+    Clock::time_point due;
+    void *item;
+    void *context;
+    bool operator<(const Request &other) const { return other.due < due; }
+  };
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::priority_queue<Request> requests;
+  bool stopping;
+  std::thread thread;
+
+  void serve() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      if (requests.empty()) {
+        cv.wait(lock);
+      } else if (Clock::now() < requests.top().due) {
+        Clock::time_point due = requests.top().due;
+        cv.wait_until(lock, due);
+      } else {
+        Request request = requests.top();
+        requests.pop();
+        wakeMap(request.item, request.context);
+      }
+    }
+  }
+
+public:
+  LookupService() : stopping(false), thread(&LookupService::serve, this) {}
+  ~LookupService() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+  void send(void *item, void *context) {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push({Clock::now() + std::chrono::milliseconds(LOOKUP_MS), item,
+                   context});
+    cv.notify_one();
+  }
+};
+
+static LookupService *service;
+
+struct Lookup {
+  int n;
+  int lookups;
+};
+
+struct AsyncClient : public MapReduceClient {
+  void map(const K1 *key, const V1 *value, void *context) const {}
+  bool mapsAsync() const { return true; }
+  void *mapAsync(const K1 *key, const V1 *value, void *context) const {
+    Lookup *lookup = new Lookup{((Number *)key)->n, 1};
+    service->send(lookup, context);
+    return lookup;
+  }
+  void *resumeMap(void *item, void *context) const {
+    Lookup *lookup = (Lookup *)item;
+    if (lookup->lookups < LOOKUPS_PER_MAP) {
+      lookup->lookups++;
+      service->send(lookup, context);
+      return lookup;
+    }
+    emit2(new Number(lookup->n % RANGE), new Number(1), context);
+    delete lookup;
+    return nullptr;
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int n = ((Number *)pairs->at(0).first)->n;
+    for (const IntermediatePair &pair : *pairs) {
+      delete pair.first;
+      delete pair.second;
+    }
+    emit3(new Number(n), new Number(pairs->size()), context);
+  }
+};
+
+// maps suspending until woken by the test, holding their wakes
+struct HeldClient : public AsyncClient {
+  mutable std::mutex mutex;
+  mutable std::vector<std::pair<void *, void *>> wakes;
+  void *mapAsync(const K1 *key, const V1 *value, void *context) const {
+    Lookup *lookup = new Lookup{((Number *)key)->n, LOOKUPS_PER_MAP};
+    std::lock_guard<std::mutex> lock(mutex);
+    wakes.push_back({lookup, context});
+    return lookup;
+  }
+  size_t numHeld() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return wakes.size();
+  }
+  // wake the held maps from first to last
+  void wake(size_t first, size_t last) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = first; i < last; i++) {
+      wakeMap(wakes[i].first, wakes[i].second);
+    }
+  }
+};
+
+// wait for the map stage to report percentage
+static bool reaches(JobHandle job, float percentage) {
+  JobState state;
+  for (int i = 0; i < 5000; i++) {
+    getJobState(job, &state);
+    if (state.stage == MAP_STAGE && state.percentage == percentage) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+// with all maps suspended the map stage has made no progress, and it has
+// made half once half of them are done
+static bool progress() {
+  InputVec input = sequenceInput(HELD);
+  HeldClient client;
+  JobConfig config = JobConfig();
+  config.mapsInFlight = HELD;
+  PoolHandle pool = createWorkerPool(1);
+  OutputVec output;
+  JobHandle job = startMapReduceJob(pool, client, input, output, 1, config);
+  while (client.numHeld() < HELD) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  bool ok = reaches(job, 0);
+  client.wake(0, HELD / 2);
+  ok = reaches(job, 50) && ok;
+  client.wake(HELD / 2, HELD);
+  closeJobHandle(job);
+  closeWorkerPool(pool);
+  ok = output.size() == RANGE && ok;
+  freeOutput(output);
+  freeInput(input);
+  return ok;
+}
+
+#if __cplusplus >= 202002L
+struct CoroutineClient : public async::Client {
+  async::MapTask mapCoroutine(const K1 *key, const V1 *value,
+                              void *context) const {
+    for (int i = 0; i < LOOKUPS_PER_MAP; i++) {
+      co_await async::suspend(context, [](async::Wake wake) {
+        service->send(wake.item, wake.context);
+      });
+    }
+    emit2(new Number(((Number *)key)->n % RANGE), new Number(1), context);
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    AsyncClient().reduce(pairs, context);
+  }
+};
+#endif
+
+// run the job and check its counts. returns its time in milliseconds, -1 on
+// wrong output
+static long run(const MapReduceClient &client, const InputVec &input) {
+  Clock::time_point start = Clock::now();
+  OutputVec output;
+  JobHandle job = startMapReduceJob(client, input, output, THREADS);
+  closeJobHandle(job);
+  long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now() - start)
+                .count();
+  bool ok = (output.size() == RANGE);
+  for (OutputPair &pair : output) {
+    ok = ok && ((Number *)pair.second)->n == N / RANGE;
+    delete pair.first;
+    delete pair.second;
+  }
+  return ok ? ms : -1;
+}
+
+int main() {
+  service = new LookupService();
+  InputVec input;
+  for (int i = 0; i < N; i++) {
+    input.push_back({new Number(i), nullptr});
+  }
+
+  // waiting for each lookup in turn would take N * 2 * 10ms / 2 threads
+  long limit = N * LOOKUPS_PER_MAP * LOOKUP_MS / THREADS / 5;
+  AsyncClient client;
+  long ms = run(client, input);
+  bool ok = ms >= 0 && ms < limit;
+#if __cplusplus >= 202002L
+  CoroutineClient coroutineClient;
+  ms = run(coroutineClient, input);
+  ok = ok && ms >= 0 && ms < limit;
+#endif
+  delete service;
+  ok = progress() && ok;
+
+  freeInput(input);
+  if (!ok) {
+    std::cout << "ERROR: WRONG OUTPUT, MAPS DIDN'T OVERLAP OR WRONG PROGRESS"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
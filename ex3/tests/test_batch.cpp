@@ -0,0 +1,93 @@
+/**
+ * Batched emits: a mapper emitting many pairs per input in batches, mixed
+ * with single emits, and a reducer emitting its output in batches, must
+ * give the counts of single emits, in memory and when spilling.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+#define N 2000
+#define FAN_OUT 100
+#define RANGE 1000
+#define THREADS 4
+#define BUDGET 10000
+
+struct FanOutClient : public CountClient {
+  // (n, -) -> (n + i, 1) for each i < FAN_OUT, in batches on even inputs
+  void map(const K1 *key, const V1 *value, void *context) const {
+    int n = ((Number *)key)->n;
+    if (n % 2 == 1) {
+      for (int i = 0; i < FAN_OUT; i++) {
+        emit2(new Number((n + i) % RANGE), new Number(1), context);
+      }
+      return;
+    }
+    IntermediatePair pairs[FAN_OUT];
+    for (int i = 0; i < FAN_OUT; i++) {
+      pairs[i] = {new Number((n + i) % RANGE), new Number(1)};
+    }
+    emit2Batch(pairs, FAN_OUT / 2, context);
+    emit2Batch(pairs + FAN_OUT / 2, FAN_OUT - FAN_OUT / 2, context);
+  }
+  // (n, count) and (-n - 1, count)
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int n = ((Number *)pairs->at(0).first)->n;
+    int count = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      count += ((Number *)pair.second)->n;
+      delete pair.first;
+      delete pair.second;
+    }
+    OutputPair output[2] = {{new Number(n), new Number(count)},
+                            {new Number(-n - 1), new Number(count)}};
+    emit3Batch(output, 2, context);
+  }
+};
+
+int main() {
+  InputVec input;
+  int expected[RANGE] = {0};
+  for (int n = 0; n < N; n++) {
+    input.push_back({new Number(n), nullptr});
+    for (int i = 0; i < FAN_OUT; i++) {
+      expected[(n + i) % RANGE]++;
+    }
+  }
+
+  FanOutClient client;
+  bool ok = true;
+  for (size_t budget : {0, BUDGET}) {
+    JobConfig config = JobConfig();
+    config.memoryBudget = budget;
+    PoolHandle pool = createWorkerPool(THREADS);
+    OutputVec output;
+    JobHandle job =
+        startMapReduceJob(pool, client, input, output, THREADS, config);
+    JobMetrics metrics;
+    waitForJob(job);
+    getJobMetrics(job, &metrics);
+    closeJobHandle(job);
+    closeWorkerPool(pool);
+
+    size_t outputPairs = 0;
+    for (const WorkerMetrics &worker : metrics.workers) {
+      outputPairs += worker.outputPairs;
+    }
+    ok = ok && output.size() == 2 * RANGE && outputPairs == 2 * RANGE;
+    for (OutputPair &pair : output) {
+      int n = ((Number *)pair.first)->n;
+      ok = ok && ((Number *)pair.second)->n == expected[n < 0 ? -n - 1 : n];
+      delete pair.first;
+      delete pair.second;
+    }
+  }
+
+  freeInput(input);
+  if (!ok) {
+    std::cout << "ERROR: WRONG OUTPUT OF BATCHED EMITS" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * Hash grouping: jobs grouping by K2::hash and K2::equals must match the
+ * counts of the input, with a good hash and with one that collides a lot,
+ * and with a long tail of rare keys that outgrows the table sized from a
+ * sample of the keys.
+ */
+#include "TestUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#define N 100000
+#define RANGE 20000
+
+// a number whose hash is taken modulo buckets, 0 for the identity
+struct Bucketed : public Number {
+  int buckets;
+  Bucketed(int n, int buckets) : Number(n), buckets(buckets) {}
+  size_t hash() const { return buckets == 0 ? n : n % buckets; }
+};
+
+struct HashClient : public CountClient {
+  int buckets;
+  explicit HashClient(int buckets) : buckets(buckets) {}
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Bucketed(((Number *)key)->n, buckets), new Number(1), context);
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int n = ((Number *)pairs->at(0).first)->n;
+    for (const IntermediatePair &pair : *pairs) {
+      if (((Number *)pair.first)->n != n) {
+        std::cout << "ERROR: KEYS " << n << " AND "
+                  << ((Number *)pair.first)->n << " IN ONE GROUP" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    CountClient::reduce(pairs, context);
+  }
+  bool hashes() const { return true; }
+};
+
+int main() {
+  InputVec input, tail;
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    input.push_back({new Number(rand() % RANGE), nullptr});
+    // a power law, most pairs on a few keys and a long tail of rare ones
+    double u = (rand() + 1.0) / (RAND_MAX + 1.0);
+    tail.push_back({new Number(std::min<double>(N - 1, pow(u, -3))), nullptr});
+  }
+
+  for (int buckets : {0, 64}) {
+    HashClient client(buckets);
+    for (int threads : {1, 4, 7}) {
+      OutputVec output;
+      JobHandle job = startMapReduceJob(client, input, output, threads);
+      closeJobHandle(job);
+      if (!checkCounts(input, output)) {
+        std::cout << "ERROR: WRONG OUTPUT WITH " << threads << " THREADS"
+                  << (buckets ? " AND COLLIDING HASHES" : "") << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  HashClient client(0);
+  for (int threads : {1, 4, 7}) {
+    OutputVec output;
+    JobHandle job = startMapReduceJob(client, tail, output, threads);
+    closeJobHandle(job);
+    if (!checkCounts(tail, output)) {
+      std::cout << "ERROR: WRONG OUTPUT WITH " << threads
+                << " THREADS AND A LONG TAIL OF KEYS" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  freeInput(input);
+  freeInput(tail);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
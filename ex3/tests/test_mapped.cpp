@@ -0,0 +1,101 @@
+/**
+ * Mapped text: word count over a mapped file split into small chunks, with
+ * words kept as views into the mapping, must match a count of the words
+ * read with a stream.
+ */
+#include "../MappedText.h"
+#include "../MapReduceClient.h"
+#include "../MapReduceFramework.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#define FILE_NAME "randomstring.txt"
+#define CHUNK_SIZE 4096
+#define THREADS 4
+
+struct Word : public K2, public K3 {
+  TextView word;
+  Word(TextView word) : word(word) {}
+  bool operator<(const K2 &other) const {
+    return word < static_cast<const Word &>(other).word;
+  }
+  bool operator<(const K3 &other) const {
+    return word < static_cast<const Word &>(other).word;
+  }
+};
+
+struct Count : public V2, public V3 {
+  int count;
+  Count(int count) : count(count) {}
+};
+
+struct WordClient : public MapReduceClient {
+  void map(const K1 *key, const V1 *value, void *context) const {
+    const TextChunk *chunk = static_cast<const TextChunk *>(value);
+    size_t pos = 0;
+    TextView line;
+    while (chunk->nextRecord(pos, line)) {
+      // words are separated by single spaces
+      const char *begin = line.data, *end = line.data + line.size;
+      while (begin < end) {
+        const char *space = begin;
+        while (space < end && *space != ' ') {
+          space++;
+        }
+        if (space != begin) {
+          emit2(new Word({begin, (size_t)(space - begin)}), new Count(1),
+                context);
+        }
+        begin = space + 1;
+      }
+    }
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    TextView word = static_cast<Word *>(pairs->at(0).first)->word;
+    for (const IntermediatePair &pair : *pairs) {
+      delete pair.first;
+      delete pair.second;
+    }
+    emit3(new Word(word), new Count(pairs->size()), context);
+  }
+};
+
+int main() {
+  // the expected counts
+  std::map<std::string, int> expected;
+  std::ifstream in(FILE_NAME);
+  std::string line, word;
+  while (std::getline(in, line)) {
+    std::istringstream words(line);
+    while (std::getline(words, word, ' ')) {
+      if (!word.empty()) {
+        expected[word]++;
+      }
+    }
+  }
+
+  WordClient client;
+  MappedText source(FILE_NAME, CHUNK_SIZE);
+  OutputVec output;
+  PoolHandle pool = createWorkerPool(THREADS);
+  JobHandle job = startMapReduceJob(pool, client, source, output, THREADS);
+  closeJobHandle(job);
+  closeWorkerPool(pool);
+
+  bool ok = (output.size() == expected.size());
+  for (OutputPair &pair : output) {
+    std::string word = static_cast<Word *>(pair.first)->word.str();
+    ok = ok && expected[word] == static_cast<Count *>(pair.second)->count;
+    delete pair.first;
+    delete pair.second;
+  }
+  if (!ok) {
+    std::cout << "ERROR: WRONG OUTPUT" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,57 @@
+/**
+ * Job metrics: read while the job runs and after it's done, the counts of
+ * every worker must add up to the job's pairs and groups.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+#define N 200000
+#define RANGE 1000
+#define THREADS 4
+
+int main() {
+  CountClient client;
+  srand(0);
+  InputVec input = randomInput(N, RANGE);
+
+  OutputVec output;
+  JobHandle job = startMapReduceJob(client, input, output, THREADS);
+  JobState state;
+  JobMetrics metrics;
+  do {
+    getJobState(job, &state);
+    getJobMetrics(job, &metrics);
+  } while (state.stage != REDUCE_STAGE || state.percentage < 100);
+  waitForJob(job);
+  getJobMetrics(job, &metrics);
+  closeJobHandle(job);
+
+  size_t inputPairs = 0, intermediatePairs = 0, groups = 0, outputPairs = 0;
+  double wallTime = 0;
+  for (const WorkerMetrics &worker : metrics.workers) {
+    inputPairs += worker.inputPairs;
+    intermediatePairs += worker.intermediatePairs;
+    groups += worker.groups;
+    outputPairs += worker.outputPairs;
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+      wallTime += worker.wallTime[phase];
+    }
+  }
+  size_t histogram = 0;
+  for (int i = 0; i < GROUP_SIZE_BUCKETS; i++) {
+    histogram += metrics.groupSizes[i];
+  }
+  if (metrics.workers.size() != THREADS || inputPairs != N ||
+      intermediatePairs != N || groups != output.size() ||
+      outputPairs != output.size() || histogram != groups ||
+      metrics.largestGroup == 0 || wallTime <= 0) {
+    std::cout << "ERROR: WRONG METRICS" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  freeOutput(output);
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * Completion notification: many jobs waited on from one epoll loop must all
+ * be reported done through their eventfds and callbacks, and the eventfd of
+ * a job that is done already must be readable.
+ */
+#include "TestUtils.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define JOBS 50
+#define N 1000
+#define RANGE 10
+
+static std::atomic<int> callbacks(0);
+
+static void onDone(JobHandle job, void *arg) {
+  // the job's state is final by now
+  JobState state;
+  getJobState(job, &state);
+  if (state.stage == REDUCE_STAGE && state.percentage == 100) {
+    callbacks++;
+  }
+}
+
+int main() {
+  CountClient client;
+  InputVec input;
+  for (int i = 0; i < N; i++) {
+    input.push_back({new Number(i % RANGE), nullptr});
+  }
+
+  PoolHandle pool = createWorkerPool(4);
+  JobConfig config = JobConfig();
+  config.onDone = onDone;
+  int epoll = epoll_create1(0);
+  OutputVec outputs[JOBS];
+  JobHandle jobs[JOBS];
+  for (int i = 0; i < JOBS; i++) {
+    jobs[i] = startMapReduceJob(pool, client, input, outputs[i], 2, config);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, getJobFd(jobs[i]), &event);
+  }
+
+  // close each job once its eventfd says it's done
+  int open = JOBS;
+  bool ok = true;
+  while (open > 0) {
+    epoll_event events[JOBS];
+    int count = epoll_wait(epoll, events, JOBS, -1);
+    for (int e = 0; e < count; e++) {
+      int i = events[e].data.u32;
+      epoll_ctl(epoll, EPOLL_CTL_DEL, getJobFd(jobs[i]), nullptr);
+      closeJobHandle(jobs[i]);
+      ok = ok && outputs[i].size() == RANGE;
+      freeOutput(outputs[i]);
+      open--;
+    }
+  }
+  close(epoll);
+
+  // a descriptor asked for after the job is done
+  OutputVec output;
+  JobHandle job = startMapReduceJob(pool, client, input, output, 2);
+  waitForJob(job);
+  uint64_t value = 0;
+  ok = ok && read(getJobFd(job), &value, sizeof(value)) == sizeof(value) &&
+       value == 1;
+  closeJobHandle(job);
+  freeOutput(output);
+  closeWorkerPool(pool);
+
+  if (!ok || callbacks != JOBS) {
+    std::cout << "ERROR: MISSED NOTIFICATIONS" << std::endl;
+    return EXIT_FAILURE;
+  }
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
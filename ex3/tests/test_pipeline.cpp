@@ -0,0 +1,110 @@
+/**
+ * Pipelines: counting keys, then counting the keys of each count, then
+ * summing those, must give the same output streamed through pipes as the
+ * stages run one by one would, on an unbounded pool and on a pool too small
+ * for the threads the stages ask for.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+
+#define N 100000
+#define RANGE 5000
+
+// the number of a pair's key or value, whichever base it's seen through
+template <class Base> static int number(const Base *object) {
+  return static_cast<const Number *>(object)->n;
+}
+
+// reduces each key to the sum of its values
+struct SumClient : public MapReduceClient {
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    int sum = 0;
+    for (const IntermediatePair &pair : *pairs) {
+      sum += number(pair.second);
+      if (pair.first != pairs->at(0).first) {
+        delete pair.first;
+      }
+      delete pair.second;
+    }
+    emit3(new Number(number(pairs->at(0).first)), new Number(sum), context);
+    delete pairs->at(0).first;
+  }
+};
+
+// (n, -) -> (n, 1)
+struct CountKeys : public SumClient {
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Number(number(key)), new Number(1), context);
+  }
+};
+
+// (n, count) -> (count, 1)
+struct CountCounts : public SumClient {
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Number(number(value)), new Number(1), context);
+  }
+};
+
+// (count, keys) -> (0, keys)
+struct SumAll : public SumClient {
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Number(0), new Number(number(value)), context);
+  }
+};
+
+int main() {
+  InputVec input;
+  std::map<int, int> counts;
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    int n = rand() % RANGE;
+    input.push_back({new Number(n), nullptr});
+    counts[n]++;
+  }
+  // keys of each count
+  std::map<int, int> expected;
+  for (const std::pair<const int, int> &count : counts) {
+    expected[count.second]++;
+  }
+
+  CountKeys countKeys;
+  CountCounts countCounts;
+  SumAll sumAll;
+  PipelineStage stages[3] = {{&countKeys, 4, JobConfig()},
+                             {&countCounts, 3, JobConfig()},
+                             {&sumAll, 2, JobConfig()}};
+  bool ok = true;
+  for (int maxThreads : {0, 4}) {
+    PoolHandle pool = createWorkerPool(0, maxThreads);
+
+    // two stages
+    OutputVec output;
+    JobHandle job = startPipeline(pool, stages, 2, input, output);
+    waitForJob(job);
+    closeJobHandle(job);
+    ok = ok && output.size() == expected.size();
+    for (OutputPair &pair : output) {
+      ok = ok && expected[number(pair.first)] == number(pair.second);
+      delete pair.first;
+      delete pair.second;
+    }
+
+    // three stages
+    output.clear();
+    job = startPipeline(pool, stages, 3, input, output);
+    closeJobHandle(job);
+    ok = ok && output.size() == 1 && number(output[0].second) == RANGE;
+    freeOutput(output);
+    closeWorkerPool(pool);
+  }
+
+  freeInput(input);
+  if (!ok) {
+    std::cout << "ERROR: WRONG PIPELINE OUTPUT" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
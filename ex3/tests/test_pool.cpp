@@ -0,0 +1,50 @@
+/**
+ * Worker pool: many small jobs on one pool, some of them at the same time,
+ * and jobs on the default pool.
+ */
+#include "TestUtils.h"
+
+#define JOBS 500
+#define CONCURRENT 8
+#define N 100
+#define RANGE 10
+
+int main() {
+  CountClient client;
+  srand(0);
+  InputVec input = randomInput(N, RANGE);
+
+  PoolHandle pool = createWorkerPool(4);
+  for (int i = 0; i < JOBS; i += CONCURRENT) {
+    OutputVec outputs[CONCURRENT];
+    JobHandle jobs[CONCURRENT];
+    // more threads than the pool has, it grows for them
+    for (int j = 0; j < CONCURRENT; j++) {
+      jobs[j] = startMapReduceJob(pool, client, input, outputs[j], 1 + j % 4);
+    }
+    for (int j = 0; j < CONCURRENT; j++) {
+      waitForJob(jobs[j]);
+      closeJobHandle(jobs[j]);
+      if (!checkCounts(input, outputs[j])) {
+        std::cout << "ERROR: WRONG OUTPUT OF JOB " << i + j << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  closeWorkerPool(pool);
+
+  // the default pool
+  for (int i = 0; i < JOBS / CONCURRENT; i++) {
+    OutputVec output;
+    JobHandle job = startMapReduceJob(client, input, output, 3);
+    closeJobHandle(job);
+    if (!checkCounts(input, output)) {
+      std::cout << "ERROR: WRONG OUTPUT ON THE DEFAULT POOL" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
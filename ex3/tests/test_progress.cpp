@@ -0,0 +1,78 @@
+/**
+ * Progress: a job held after a tenth of its maps, and again after a tenth of
+ * its reduces, must report exactly that tenth of the stage as done, though
+ * the items are claimed in chunks far larger than that.
+ */
+#include "TestUtils.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+#define N 1000
+#define HELD (N / 10)
+// most polls for the expected state, 1ms apart
+#define MAX_POLLS 5000
+
+// counts keys, holding the map and reduce calls after the first HELD of each
+// until released
+struct HoldingClient : public CountClient {
+  mutable std::atomic<int> maps, reduces;
+  std::atomic<bool> mapsReleased, reducesReleased;
+  HoldingClient()
+      : maps(0), reduces(0), mapsReleased(false), reducesReleased(false) {}
+  static void hold(std::atomic<int> &calls,
+                   const std::atomic<bool> &released) {
+    if (calls++ == HELD) {
+      while (!released) {
+        usleep(100);
+      }
+    }
+  }
+  void map(const K1 *key, const V1 *value, void *context) const {
+    hold(maps, mapsReleased);
+    CountClient::map(key, value, context);
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    hold(reduces, reducesReleased);
+    CountClient::reduce(pairs, context);
+  }
+};
+
+// wait for the job to report stage with HELD of N items done
+static bool reaches(JobHandle job, stage_t stage) {
+  JobState state;
+  for (int i = 0; i < MAX_POLLS; i++) {
+    getJobState(job, &state);
+    if (state.stage == stage &&
+        std::fabs(state.percentage - 100.0f * HELD / N) < 0.01) {
+      return true;
+    }
+    usleep(1000);
+  }
+  std::cout << "stage " << state.stage << " at " << state.percentage << "%"
+            << std::endl;
+  return false;
+}
+
+int main() {
+  InputVec input = sequenceInput(N);
+  HoldingClient client;
+  OutputVec output;
+  // a single thread claims half the input as its first chunk
+  JobHandle job = startMapReduceJob(client, input, output, 1);
+  bool ok = reaches(job, MAP_STAGE);
+  client.mapsReleased = true;
+  ok = reaches(job, REDUCE_STAGE) && ok;
+  client.reducesReleased = true;
+  closeJobHandle(job);
+
+  if (!checkCounts(input, output) || !ok) {
+    std::cout << "ERROR: WRONG OUTPUT OR PROGRESS" << std::endl;
+    return EXIT_FAILURE;
+  }
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
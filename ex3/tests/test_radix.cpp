@@ -0,0 +1,99 @@
+/**
+ * Radix sort: string keys normalized to their first 8 bytes must group like
+ * compared keys, also when many keys share those 8 bytes.
+ */
+#include "../MapReduceClient.h"
+#include "../MapReduceFramework.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#define N 100000
+#define RANGE 3000
+#define THREADS 4
+
+struct Line : public K1, public V1 {
+  std::string s;
+  Line(std::string s) : s(s) {}
+  bool operator<(const K1 &other) const { return s < ((Line &)other).s; }
+};
+
+struct Word : public K2, public V2, public K3, public V3 {
+  std::string s;
+  Word(std::string s) : s(s) {}
+  bool operator<(const K2 &other) const { return s < ((Word &)other).s; }
+  bool operator<(const K3 &other) const { return s < ((Word &)other).s; }
+  // the first 8 bytes, big-endian and zero padded
+  uint64_t normalizedKey() const {
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; i++) {
+      key = (key << 8) | (i < s.size() ? (unsigned char)s[i] : 0);
+    }
+    return key;
+  }
+};
+
+struct Count : public V2, public V3 {
+  int count;
+  Count(int count) : count(count) {}
+};
+
+struct WordClient : public MapReduceClient {
+  void map(const K1 *key, const V1 *value, void *context) const {
+    emit2(new Word(((Line *)key)->s), new Count(1), context);
+  }
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    std::string s = ((Word *)pairs->at(0).first)->s;
+    for (const IntermediatePair &pair : *pairs) {
+      if (((Word *)pair.first)->s != s) {
+        std::cout << "ERROR: " << s << " AND " << ((Word *)pair.first)->s
+                  << " IN ONE GROUP" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      delete pair.first;
+      delete pair.second;
+    }
+    emit3(new Word(s), new Count(pairs->size()), context);
+  }
+  bool normalizesKeys() const { return true; }
+};
+
+int main() {
+  // short keys, and long keys sharing their first 8 bytes
+  InputVec input;
+  std::map<std::string, int> expected;
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    int n = rand() % RANGE;
+    std::string s = std::to_string(n);
+    if (n % 2 == 1) {
+      s = "prefix__" + s;
+    }
+    input.push_back({new Line(s), nullptr});
+    expected[s]++;
+  }
+
+  WordClient client;
+  OutputVec output;
+  JobHandle job = startMapReduceJob(client, input, output, THREADS);
+  closeJobHandle(job);
+
+  bool ok = (output.size() == expected.size());
+  for (OutputPair &pair : output) {
+    ok = ok &&
+         expected[((Word *)pair.first)->s] == ((Count *)pair.second)->count;
+    delete pair.first;
+    delete pair.second;
+  }
+  if (!ok) {
+    std::cout << "ERROR: WRONG OUTPUT" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (InputPair &pair : input) {
+    delete pair.first;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * Scheduling: on a bounded pool kept busy by one job, waiting jobs must
+ * start by priority, then small before large. a job alone asking for more
+ * threads than the bound must leave a quarter of the bound to later jobs,
+ * and a job started beside a running one must get its share of the threads
+ * left, running at once instead of waiting for the other to finish, also
+ * when the other asked for the whole bound.
+ */
+#include "TestUtils.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+#define MAX_THREADS 4
+#define SMALL 100
+#define LARGE 10000
+
+static std::atomic<bool> released(false);
+static std::atomic<int> started(0);
+
+struct OrderClient : public CountClient {
+  // whether map waits for the release, and the order the job started in
+  bool blocks;
+  mutable std::atomic<int> order;
+  explicit OrderClient(bool blocks) : blocks(blocks), order(-1) {}
+  void map(const K1 *key, const V1 *value, void *context) const {
+    int unset = -1;
+    if (order.compare_exchange_strong(unset, -2)) {
+      order = started++;
+    }
+    while (blocks && !released) {
+      usleep(1000);
+    }
+    CountClient::map(key, value, context);
+  }
+};
+
+// start jobs behind a blocking one on a pool of one thread, returns false
+// if they started in the wrong order
+static bool startOrder(const InputVec &small, const InputVec &large) {
+  PoolHandle pool = createWorkerPool(0, 1);
+  released = false;
+  started = 0;
+
+  // keeps the pool busy until the others are queued
+  OrderClient blocker(true), batch(false), interactive(false), urgent(false);
+  OutputVec outputs[4];
+  JobConfig config = JobConfig();
+  JobHandle blockerJob =
+      startMapReduceJob(pool, blocker, small, outputs[0], 1, config);
+  while (started == 0) {
+    usleep(1000);
+  }
+  JobHandle batchJob =
+      startMapReduceJob(pool, batch, large, outputs[1], 1, config);
+  JobHandle interactiveJob =
+      startMapReduceJob(pool, interactive, small, outputs[2], 1, config);
+  config.priority = 1;
+  JobHandle urgentJob =
+      startMapReduceJob(pool, urgent, large, outputs[3], 1, config);
+  released = true;
+
+  JobHandle jobs[] = {blockerJob, batchJob, interactiveJob, urgentJob};
+  for (JobHandle job : jobs) {
+    closeJobHandle(job);
+  }
+  closeWorkerPool(pool);
+
+  bool ok = checkCounts(small, outputs[0]) && checkCounts(large, outputs[1]) &&
+            checkCounts(small, outputs[2]) && checkCounts(large, outputs[3]);
+  return ok && urgent.order == 1 && interactive.order == 2 &&
+         batch.order == 3;
+}
+
+static void onDone(JobHandle job, void *arg) {
+  *(std::atomic<bool> *)arg = true;
+}
+
+// start a job asking for every thread beside a blocking one asking for
+// blockerThreads, returns false if the job doesn't get expectedThreads and
+// finish before the other
+static bool beside(int blockerThreads, int expectedThreads,
+                   const InputVec &small, const InputVec &large) {
+  PoolHandle pool = createWorkerPool(0, MAX_THREADS);
+  released = false;
+  started = 0;
+
+  OrderClient blocker(true), batch(false);
+  OutputVec outputs[2];
+  JobHandle blockerJob =
+      startMapReduceJob(pool, blocker, small, outputs[0], blockerThreads);
+  while (started == 0) {
+    usleep(1000);
+  }
+  // the blocker is released once the batch job is done, or after a while
+  // if the batch job waits for it
+  std::atomic<bool> batchDone(false);
+  JobConfig config = JobConfig();
+  config.onDone = onDone;
+  config.onDoneArg = &batchDone;
+  JobHandle batchJob =
+      startMapReduceJob(pool, batch, large, outputs[1], MAX_THREADS, config);
+  for (int i = 0; i < 5000 && !batchDone; i++) {
+    usleep(1000);
+  }
+  bool first = batchDone;
+  released = true;
+
+  JobMetrics batchMetrics;
+  getJobMetrics(batchJob, &batchMetrics);
+  closeJobHandle(blockerJob);
+  closeJobHandle(batchJob);
+  closeWorkerPool(pool);
+
+  bool ok = checkCounts(small, outputs[0]) && checkCounts(large, outputs[1]);
+  return ok && first && (int)batchMetrics.workers.size() == expectedThreads;
+}
+
+// start a job alone on a pool asking for more threads than the bound,
+// returns false if it doesn't leave the headroom
+static bool alone(const InputVec &small) {
+  PoolHandle pool = createWorkerPool(0, MAX_THREADS);
+  CountClient client;
+  OutputVec output;
+  JobHandle job =
+      startMapReduceJob(pool, client, small, output, 2 * MAX_THREADS);
+  JobMetrics metrics;
+  getJobMetrics(job, &metrics);
+  closeJobHandle(job);
+  closeWorkerPool(pool);
+  return checkCounts(small, output) &&
+         metrics.workers.size() == MAX_THREADS - MAX_THREADS / 4;
+}
+
+int main() {
+  InputVec small = sequenceInput(SMALL), large = sequenceInput(LARGE);
+  if (!startOrder(small, large)) {
+    std::cout << "ERROR: WRONG OUTPUT OR JOBS STARTED IN THE WRONG ORDER"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  // a job beside one taking what it can of the bound gets the thread left
+  if (!alone(small) ||
+      !beside(MAX_THREADS / 2, MAX_THREADS / 2, small, large) ||
+      !beside(MAX_THREADS, 1, small, large)) {
+    std::cout << "ERROR: WRONG OUTPUT OR THREADS" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  freeInput(small);
+  freeInput(large);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
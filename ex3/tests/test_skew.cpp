@@ -0,0 +1,60 @@
+/**
+ * Skew: a key holding half of the pairs must be split and combined in parts
+ * for an associative client, sorted or hashed, and reduced whole otherwise.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+#define N 200000
+#define RANGE 1000
+#define HOT_KEY 7
+#define THREADS 4
+
+// counts, folding the parts of split groups with its combine
+struct SumClient : public CountClient {
+  bool associative_;
+  bool hashes_;
+  SumClient(bool associative, bool hashes)
+      : associative_(associative), hashes_(hashes) {}
+  bool associative() const { return associative_; }
+  bool hashes() const { return hashes_; }
+};
+
+int main() {
+  InputVec input;
+  int expected[RANGE] = {0};
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    int n = (i % 2 == 0) ? HOT_KEY : rand() % RANGE;
+    input.push_back({new Number(n), nullptr});
+    expected[n]++;
+  }
+
+  for (bool associative : {false, true}) {
+    for (bool hashes : {false, true}) {
+      SumClient client(associative, hashes);
+      OutputVec output;
+      JobHandle job = startMapReduceJob(client, input, output, THREADS);
+      JobMetrics metrics;
+      waitForJob(job);
+      getJobMetrics(job, &metrics);
+      closeJobHandle(job);
+
+      bool ok = checkCounts(input, output);
+      // the hot group reaches reduce folded only if it was split
+      bool split = metrics.largestGroup < (size_t)expected[HOT_KEY];
+      if (!ok || split != associative) {
+        std::cout << "ERROR: WRONG OUTPUT OR SPLIT"
+                  << (associative ? " WITH" : " WITHOUT")
+                  << " AN ASSOCIATIVE REDUCE" << (hashes ? ", HASHED" : "")
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * Input sources: a job pulling its input from a generator must match the
+ * counts of the generated pairs, and only a few batches of input may be
+ * alive at a time.
+ */
+#include "TestUtils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#define N 1000000
+#define RANGE 1000
+#define THREADS 4
+
+// generates i % RANGE for i in [0, N), counting the pairs alive
+struct Generator : public InputSource {
+  int next_;
+  int alive;
+  int maxAlive;
+  Generator() : next_(0), alive(0), maxAlive(0) {}
+  size_t next(InputVec &batch, size_t max) {
+    size_t count = 0;
+    for (; count < max && next_ < N; count++, next_++) {
+      batch.push_back({new Number(next_ % RANGE), nullptr});
+    }
+    alive += count;
+    maxAlive = std::max(alive, maxAlive);
+    return count;
+  }
+  void release(const InputVec &batch) {
+    for (const InputPair &pair : batch) {
+      delete pair.first;
+    }
+    alive -= batch.size();
+  }
+  size_t size() const { return N; }
+};
+
+int main() {
+  CountClient client(true);
+  Generator source;
+  OutputVec output;
+  PoolHandle pool = createWorkerPool(THREADS);
+  JobHandle job = startMapReduceJob(pool, client, source, output, THREADS);
+  closeJobHandle(job);
+  closeWorkerPool(pool);
+
+  bool ok = (output.size() == RANGE);
+  for (OutputPair &pair : output) {
+    ok = ok && ((Number *)pair.second)->n == N / RANGE;
+    delete pair.first;
+    delete pair.second;
+  }
+  if (!ok || source.alive != 0) {
+    std::cout << "ERROR: WRONG OUTPUT" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // each thread holds a single batch
+  if (source.maxAlive > N / 100) {
+    std::cout << "ERROR: " << source.maxAlive << " INPUT PAIRS ALIVE AT ONCE"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * Spilling: jobs over a memory budget much smaller than their intermediate
+ * pairs, with and without a combiner, must match the counts of the input.
+ * they spill hundreds of runs, which must be merged down to keep the files
+ * open at once under a low limit, also when many threads each read the runs
+ * of all others.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+#include <sys/resource.h>
+
+#define N 100000
+#define RANGE 5000
+#define BUDGET 1000
+#define MAX_OPEN_FILES 512
+
+int main() {
+  // reading every run at once would take a few thousand files
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = MAX_OPEN_FILES;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  srand(0);
+  InputVec input = randomInput(N, RANGE);
+
+  JobConfig config = JobConfig();
+  config.memoryBudget = BUDGET;
+  PoolHandle pool = createWorkerPool(4);
+  for (bool combiner : {false, true}) {
+    CountClient client(combiner);
+    for (int threads : {1, 4, 16, 32}) {
+      OutputVec output;
+      JobHandle job =
+          startMapReduceJob(pool, client, input, output, threads, config);
+      JobState state;
+      getJobState(job, &state);
+      closeJobHandle(job);
+      if (!checkCounts(input, output)) {
+        std::cout << "ERROR: WRONG OUTPUT WITH " << threads << " THREADS"
+                  << (combiner ? " AND A COMBINER" : "") << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  closeWorkerPool(pool);
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
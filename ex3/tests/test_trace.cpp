@@ -0,0 +1,69 @@
+/**
+ * Tracing: a traced job must write a Chrome trace with the spans of every
+ * phase, and an untraced job must not write one. a trace that can't be
+ * written must leave the job's output whole.
+ */
+#include "TestUtils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define N 10000
+#define RANGE 100
+#define THREADS 4
+#define TRACE_FILE "/tmp/mapreduce-test-trace.json"
+#define UNWRITABLE_FILE "/nonexistent/mapreduce-test-trace.json"
+
+// returns false on wrong output
+static bool runJob(const InputVec &input, const char *traceFile) {
+  CountClient client;
+  OutputVec output;
+  JobConfig config = JobConfig();
+  config.traceFile = traceFile;
+  PoolHandle pool = createWorkerPool(THREADS);
+  JobHandle job =
+      startMapReduceJob(pool, client, input, output, THREADS, config);
+  closeJobHandle(job);
+  closeWorkerPool(pool);
+  return checkCounts(input, output);
+}
+
+int main() {
+  srand(0);
+  InputVec input = randomInput(N, RANGE);
+
+  remove(TRACE_FILE);
+  bool ok = runJob(input, nullptr);
+  if (std::ifstream(TRACE_FILE)) {
+    std::cout << "ERROR: AN UNTRACED JOB WROTE A TRACE" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // the error is reported, and the job is still done
+  ok = runJob(input, UNWRITABLE_FILE) && ok;
+
+  ok = runJob(input, TRACE_FILE) && ok;
+  std::stringstream trace;
+  trace << std::ifstream(TRACE_FILE).rdbuf();
+  std::string text = trace.str();
+  remove(TRACE_FILE);
+  const char *spans[] = {"\"map\"",           "\"sort\"",
+                         "\"shuffle\"",       "\"reduce\"",
+                         "\"map items\"",     "\"reduce groups\"",
+                         "\"barrier wait\"",  "\"tid\":3"};
+  ok = ok && text.compare(0, 16, "{\"traceEvents\":[") == 0 &&
+            text.compare(text.size() - 3, 3, "]}\n") == 0;
+  for (const char *span : spans) {
+    ok = ok && text.find(span) != std::string::npos;
+  }
+  if (!ok) {
+    std::cout << "ERROR: WRONG OUTPUT OR TRACE" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * Typed front end: count random numbers by value and compare with a direct
+ * count, for several thread counts.
+ */
+#include "../MapReduceTyped.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#define N 200000
+#define RANGE 5000
+
+struct CountClient {
+  typedef int K1;
+  typedef std::string V1;
+  typedef int K2;
+  typedef int V2;
+  typedef int K3;
+  typedef int V3;
+
+  void map(const int &key, const std::string &value,
+           typed::Emitter<int, int> &emit) const {
+    emit(key, value.size());
+  }
+
+  void reduce(const int &key, const std::pair<int, int> *begin,
+              const std::pair<int, int> *end,
+              typed::Emitter<int, int> &emit) const {
+    int count = 0;
+    for (const std::pair<int, int> *pair = begin; pair != end; ++pair) {
+      count += pair->second;
+    }
+    emit(key, count);
+  }
+};
+
+int main() {
+  typedef typed::MapReduceJob<CountClient> Job;
+  Job::InputVec input;
+  std::map<int, int> expected;
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    int n = rand() % RANGE;
+    std::string value(rand() % 3 + 1, 'x');
+    input.push_back({n, value});
+    expected[n] += value.size();
+  }
+
+  CountClient client;
+  for (int threads : {1, 3, 16}) {
+    Job::OutputVec output;
+    Job job(client, input, output, threads);
+    job.wait();
+    JobState state;
+    job.getState(&state);
+    if (state.stage != REDUCE_STAGE || state.percentage != 100) {
+      std::cout << "ERROR: JOB NOT DONE AFTER WAIT" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (output.size() != expected.size()) {
+      std::cout << "ERROR: " << output.size() << " KEYS, EXPECTED "
+                << expected.size() << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < output.size(); i++) {
+      auto iter = expected.find(output[i].first);
+      if (iter == expected.end() || iter->second != output[i].second ||
+          (i > 0 && !(output[i - 1].first < output[i].first))) {
+        std::cout << "ERROR OF KEY: " << output[i].first << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}
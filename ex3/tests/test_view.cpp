@@ -0,0 +1,74 @@
+/**
+ * Grouped views: a client reducing views of the sorted runs must get every
+ * pair of each key exactly once, whether the groups are sorted, hashed or
+ * split and combined in parts, and its vector reduce must not be called.
+ */
+#include "TestUtils.h"
+#include <cstdlib>
+#include <iostream>
+
+#define N 200000
+#define RANGE 1000
+#define HOT_KEY 7
+#define THREADS 4
+
+struct ViewClient : public CountClient {
+  bool associative_;
+  bool hashes_;
+  ViewClient(bool associative, bool hashes)
+      : associative_(associative), hashes_(hashes) {}
+  void reduce(const IntermediateVec *pairs, void *context) const {
+    std::cout << "ERROR: REDUCE CALLED INSTEAD OF REDUCEGROUP" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // sum the group in place, -1 if it holds pairs of another key
+  void reduceGroup(const GroupView *group, void *context) const {
+    int n = ((Number *)group->begin()->first)->n;
+    int sum = 0;
+    size_t size = 0;
+    for (const IntermediatePair &pair : *group) {
+      sum = (((Number *)pair.first)->n != n || sum < 0)
+                ? -1
+                : sum + ((Number *)pair.second)->n;
+      size++;
+    }
+    for (const IntermediatePair &pair : *group) {
+      delete pair.first;
+      delete pair.second;
+    }
+    emit3(new Number(n), new Number(size == group->size() ? sum : -1),
+          context);
+  }
+  bool associative() const { return associative_; }
+  bool hashes() const { return hashes_; }
+};
+
+int main() {
+  InputVec input;
+  srand(0);
+  for (int i = 0; i < N; i++) {
+    int n = (i % 2 == 0) ? HOT_KEY : rand() % RANGE;
+    input.push_back({new Number(n), nullptr});
+  }
+
+  for (bool associative : {false, true}) {
+    for (bool hashes : {false, true}) {
+      ViewClient client(associative, hashes);
+      OutputVec output;
+      JobHandle job = startMapReduceJob(client, input, output, THREADS);
+      closeJobHandle(job);
+
+      if (!checkCounts(input, output)) {
+        std::cout << "ERROR: WRONG GROUPS"
+                  << (associative ? " WITH" : " WITHOUT")
+                  << " AN ASSOCIATIVE REDUCE" << (hashes ? ", HASHED" : "")
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  freeInput(input);
+  std::cout << "PASSED THE TEST!" << std::endl;
+  return 0;
+}